@@ -82,6 +82,7 @@ struct App : public OpenGLApplication
 	void onClose() override {
 		basicProg.deleteShaders();
 		basicProg.deleteProgram();
+		cube.deleteObjects();
 	}
 
 	// Appelée lors d'une touche de clavier.
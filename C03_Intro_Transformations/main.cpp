@@ -79,6 +79,7 @@ struct App : public OpenGLApplication
 	void onClose() override {
 		basicProg.deleteShaders();
 		basicProg.deleteProgram();
+		triangle.deleteObjects();
 	}
 
 	// Appelée lors d'une touche de clavier.
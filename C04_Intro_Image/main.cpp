@@ -107,6 +107,7 @@ struct App : public OpenGLApplication
 	void onClose() override {
 		basicProg.deleteShaders();
 		basicProg.deleteProgram();
+		square.deleteObjects();
 	}
 
 	// Appelée lors d'une touche de clavier.
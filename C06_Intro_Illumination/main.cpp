@@ -29,7 +29,7 @@ struct App : public OpenGLApplication
 {
 	Mesh sphere;
 	Mesh triangle;
-	Texture texRock;
+	AssetHandle<Texture> texRock;
 	Texture texYellow;
 	ShaderProgram basicProg;
 	ShaderProgram prog;
@@ -77,8 +77,9 @@ struct App : public OpenGLApplication
 
 		texYellow = Texture::createFromColor({1, 1, 0.5f, 1});
 		texYellow.bindToTextureUnit(0, basicProg, "texMain");
-		texRock = Texture::loadFromFile("rock.png", 5);
-		texRock.bindToTextureUnit(1, prog, "texMain");
+		// La texture est chargée en arrière-plan; une texture grise la remplace en attendant.
+		texRock = getAssetLoader().loadTexture("rock.png", 5);
+		texRock->bindToTextureUnit(1, prog, "texMain");
 
 		camera.updateProgram(basicProg, view);
 		camera.updateProgram(prog, view);
@@ -99,7 +100,7 @@ struct App : public OpenGLApplication
 		sphere.draw();
 
 		prog.use();
-		texRock.bindToTextureUnit(1);
+		texRock->bindToTextureUnit(1);
 		prog.setVec("lightPosition", lightPosition);
 		triangle.draw();
 	}
@@ -112,6 +113,9 @@ struct App : public OpenGLApplication
 		prog.deleteProgram();
 		sphere.deleteObjects();
 		triangle.deleteObjects();
+		texYellow.deleteObject();
+		if (texRock.isReady())
+			texRock->deleteObject();
 	}
 
 	// Appelée lors d'une touche de clavier.
@@ -0,0 +1,45 @@
+#version 410
+
+
+// Exemple de nuanceur pour les mesh compressés de PackedMesh.hpp. L'exercice ne l'utilise pas : il trace des Mesh ordinaires avec vert.glsl. Pour l'essayer, voir le commentaire de makePackedMesh.
+
+
+uniform mat4 model = mat4(1);
+uniform mat4 view = mat4(1);
+uniform mat4 projection = mat4(1);
+// Ramène les positions normalisées dans [0,1] à leurs valeurs d'origine (voir PositionDecode::setUniform).
+uniform mat4 positionDecode = mat4(1);
+
+
+// Mêmes localisations que vert.glsl, mais avec les sommets compressés de PackedMesh (voir makePackedMesh) : OpenGL convertit déjà les entiers normalisés et les demi-flottants en float.
+layout(location = 0) in vec3 a_position;  // Dans [0,1], quantifiée dans la boîte englobante du mesh.
+layout(location = 1) in vec2 a_normal;    // Encodée en octaèdre.
+layout(location = 2) in vec2 a_texCoords;
+
+
+out vec2 texCoords;
+out vec3 sceneCoords;
+out vec3 sceneNormal;
+
+
+// L'inverse de encodeOctahedral (PackedMesh.hpp) : replier la moitié inférieure du carré sur l'octaèdre.
+vec3 decodeOctahedral(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+
+void main() {
+	// Décoder la position avant les transformations habituelles.
+	vec4 worldPosition = model * positionDecode * vec4(a_position, 1.0);
+	vec4 viewPosition = view * worldPosition;
+	vec4 clipPosition = projection * viewPosition;
+
+	gl_Position = clipPosition;
+	texCoords = a_texCoords;
+	sceneCoords = worldPosition.xyz;
+	// La normale ne subit pas la mise à l'échelle de la quantification (une échelle non uniforme la fausserait), seulement la modélisation.
+	sceneNormal = normalize(mat3(transpose(inverse(model))) * decodeOctahedral(a_normal));
+}
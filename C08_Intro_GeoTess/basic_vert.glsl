@@ -4,6 +4,8 @@
 uniform mat4 model = mat4(1);
 uniform mat4 view = mat4(1);
 uniform mat4 projection = mat4(1);
+// La région de la texture à échantillonner (voir AtlasRegion::getUvTransform) : décalage dans xy, échelle dans zw.
+uniform vec4 texTransform = vec4(0, 0, 1, 1);
 
 
 layout(location = 0) in vec3 a_position;
@@ -21,5 +23,5 @@ void main() {
 	vec4 clipPosition = projection * viewPosition;
 
 	gl_Position = clipPosition;
-	texCoords = a_texCoords;
+	texCoords = texTransform.xy + a_texCoords * texTransform.zw;
 }
@@ -0,0 +1,18 @@
+#version 410
+
+
+// Comme basic_frag.glsl, mais avec une texture tableau (voir TextureArray).
+uniform sampler2DArray texMain;
+
+
+in vec2 texCoords;
+flat in float textureLayer;
+
+
+out vec4 fragColor;
+
+
+void main() {
+	// Échantillonner la couche de la texture.
+	fragColor = texture(texMain, vec3(texCoords, textureLayer));
+}
@@ -0,0 +1,29 @@
+#version 410
+
+
+uniform mat4 model = mat4(1);
+uniform mat4 view = mat4(1);
+uniform mat4 projection = mat4(1);
+
+
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in vec3 a_normal;
+layout(location = 2) in vec2 a_texCoords;
+// La couche de la texture tableau : par instance (InstanceData), par appel (GeometryArena::addDraw) ou donnée par TextureArray::setCurrentLayer pour un appel simple.
+layout(location = 9) in float i_textureLayer;
+
+
+out vec2 texCoords;
+flat out float textureLayer;
+
+
+void main() {
+	// Appliquer les transformations habituelles.
+	vec4 worldPosition = model * vec4(a_position, 1.0);
+	vec4 viewPosition = view * worldPosition;
+	vec4 clipPosition = projection * viewPosition;
+
+	gl_Position = clipPosition;
+	texCoords = a_texCoords;
+	textureLayer = i_textureLayer;
+}
@@ -17,7 +17,8 @@
 #include <inf2705/OpenGLApplication.hpp>
 #include <inf2705/Mesh.hpp>
 #include <inf2705/ShaderProgram.hpp>
-#include <inf2705/Texture.hpp>
+#include <inf2705/StreamingBuffer.hpp>
+#include <inf2705/TextureAtlas.hpp>
 #include <inf2705/TransformStack.hpp>
 #include <inf2705/OrbitCamera.hpp>
 
@@ -28,10 +29,15 @@ using namespace glm;
 
 struct App : public OpenGLApplication
 {
-	Mesh sineLine;
-	Mesh refQuad;
-	Texture texYellow;
-	Texture texWhite;
+	// Seulement des positions pour des lignes (12 octets par sommet au lieu de 48).
+	BasicMesh<PositionVertexData> sineLine;
+	BasicMesh<PositionVertexData> refQuad;
+	// La courbe change à chaque trame, elle est donc écrite dans un tampon partagé projeté en mémoire plutôt que dans ses propres tampons.
+	StreamingBuffer streamingBuffer;
+	// Les couleurs unies partagent une seule texture : on la lie une fois et on choisit la couleur par la transformation des coordonnées de texture.
+	TextureAtlas colorAtlas = {{64, 64}};
+	AtlasRegion yellow;
+	AtlasRegion white;
 	ShaderProgram basicProg;
 
 	TransformStack model = {"model"};
@@ -68,27 +74,29 @@ struct App : public OpenGLApplication
 
 		loadShaders();
 
-		texYellow = Texture::createFromColor({1, 1, 0.5f, 1});
-		texWhite = Texture::createFromColor({1, 1, 1, 1});
+		yellow = colorAtlas.addColor({1, 1, 0.5f, 1});
+		white = colorAtlas.addColor({1, 1, 1, 1});
+		colorAtlas.upload();
+		colorAtlas.bindPage(0, 0);
 		basicProg.use();
 		basicProg.setInt("texMain", 0);
 
 		refQuad.vertices = {
-			{{0, -1.1f, 0}, {}, {}},
-			{{1, -1.1f, 0}, {}, {}},
-			{{1,  1.1f, 0}, {}, {}},
-			{{0,  1.1f, 0}, {}, {}},
+			{{0, -1.1f, 0}},
+			{{1, -1.1f, 0}},
+			{{1,  1.1f, 0}},
+			{{0,  1.1f, 0}},
 		};
 		refQuad.setup();
 
 		sineLine.vertices = {
-			{{0.00f,  0, 0}, {}, {}},
-			{{0.25f,  1, 0}, {}, {}},
-			{{0.50f,  0, 0}, {}, {}},
-			{{0.75f, -1, 0}, {}, {}},
-			{{1.00f,  0, 0}, {}, {}},
+			{{0.00f,  0, 0}},
+			{{0.25f,  1, 0}},
+			{{0.50f,  0, 0}},
+			{{0.75f, -1, 0}},
+			{{1.00f,  0, 0}},
 		};
-		sineLine.setup();
+		streamingBuffer.create(64 * 1024);
 
 		camera.updateProgram(basicProg, view);
 		applyPerspective();
@@ -97,6 +105,7 @@ struct App : public OpenGLApplication
 	// Appelée à chaque trame. Le buffer swap est fait juste après.
 	void drawFrame() override {
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		streamingBuffer.beginFrame();
 
 		using std::numbers::pi;
 
@@ -113,7 +122,7 @@ struct App : public OpenGLApplication
 			// La formule de l'onde est sin(2π(t + x))
 			position.y = /* TODO */;
 		}
-		sineLine.setup();
+		sineLine.stream(streamingBuffer);
 
 		// Affichage de la courbe et du cadre.
 		model.push(); {
@@ -121,16 +130,22 @@ struct App : public OpenGLApplication
 			model.translate({-0.5f, 0, 0});
 			basicProg.setMat(model);
 		} model.pop();
-		texWhite.bindToTextureUnit(0);
+		basicProg.setVec("texTransform", white.getUvTransform());
 		refQuad.draw(GL_LINE_LOOP);
-		texYellow.bindToTextureUnit(0);
+		basicProg.setVec("texTransform", yellow.getUvTransform());
 		sineLine.draw(GL_LINE_STRIP);
+
+		streamingBuffer.endFrame();
 	}
 
 	// Appelée lorsque la fenêtre se ferme.
 	void onClose() override {
 		basicProg.deleteShaders();
 		basicProg.deleteProgram();
+		sineLine.deleteObjects();
+		refQuad.deleteObjects();
+		streamingBuffer.deleteObject();
+		colorAtlas.deleteObjects();
 	}
 
 	// Appelée lors d'une touche de clavier.
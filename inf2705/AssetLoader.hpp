@@ -0,0 +1,349 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+#include <SFML/Graphics.hpp>
+
+#include "GpuMemory.hpp"
+#include "Mesh.hpp"
+#include "Mipmaps.hpp"
+#include "Texture.hpp"
+#include "ThreadPool.hpp"
+#include "UploadThread.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+enum class AssetState
+{
+	Loading, // Lecture et décodage en cours (ou en attente de l'envoi en mémoire graphique).
+	Ready,
+	Failed,
+};
+
+// Une ressource chargée en arrière-plan par AssetLoader. La ressource est gardée par un pointeur partagé : le handle peut être copié et la référence retournée par get() reste valide tant qu'un handle existe. Avant la fin du chargement, get() retourne la ressource de remplacement (une texture unie, un mesh vide qui ne trace rien).
+template <typename Resource>
+class AssetHandle
+{
+public:
+	struct Slot
+	{
+		Resource resource;
+		AssetState state = AssetState::Loading;
+		std::promise<bool> promise;
+		std::shared_future<bool> future = promise.get_future().share();
+	};
+
+	AssetHandle() = default;
+	AssetHandle(std::shared_ptr<Slot> slot) : slot_(std::move(slot)) { }
+
+	bool isValid() const { return slot_ != nullptr; }
+	AssetState getState() const { return slot_->state; }
+	bool isReady() const { return slot_->state == AssetState::Ready; }
+	bool isFailed() const { return slot_->state == AssetState::Failed; }
+
+	Resource& get() { return slot_->resource; }
+	const Resource& get() const { return slot_->resource; }
+	Resource& operator*() { return get(); }
+	Resource* operator->() { return &get(); }
+
+	// Résolu avec true quand la ressource est prête (envoyée en mémoire graphique) ou false si le chargement a échoué. On ne doit pas attendre ce futur dans le fil principal avant d'avoir appelé AssetLoader::processUploads, sinon on attend pour toujours.
+	std::shared_future<bool> getFuture() const { return slot_->future; }
+
+private:
+	std::shared_ptr<Slot> slot_;
+};
+
+// Chargement asynchrone des ressources : la lecture des fichiers et le décodage (images, fichiers Wavefront) se font sur un bassin de fils, puis l'envoi en mémoire graphique, qui doit se faire dans le fil du contexte OpenGL, est fait par processUploads à chaque trame (OpenGLApplication::run s'en occupe). processUploads envoie au plus un budget d'octets par trame pour éviter les saccades : une grosse texture est envoyée en bandes de rangées sur plusieurs trames.
+// La scène peut donc commencer à s'afficher tout de suite avec les ressources de remplacement, qui sont remplacées au fur et à mesure.
+// Les ressources chargées appartiennent à l'application, qui doit les libérer (deleteObject(s)) comme d'habitude, mais seulement si elles sont prêtes : avant, get() est une copie de la texture de remplacement, et les ressources pas encore publiées sont libérées par deleteObjects.
+class AssetLoader
+{
+public:
+	AssetLoader(ThreadPool& pool = ThreadPool::getDefault()) : pool_(&pool), queue_(std::make_shared<UploadQueue>()) { }
+
+	~AssetLoader() {
+		setUploadThread(nullptr);
+	}
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// Faire les envois dans le contexte partagé d'un fil d'envoi plutôt que dans processUploads. processUploads ne fait alors que publier les ressources dont la barrière est posée, ce qui ne coûte presque rien à la trame. nullptr pour revenir aux envois dans le fil principal.
+	void setUploadThread(UploadThread* uploadThread) {
+		std::lock_guard lock(queue_->mutex);
+		queue_->uploadThread = uploadThread;
+	}
+
+	// Couleur de la texture affichée en attendant le chargement.
+	void setPlaceholderColor(vec4 color) { placeholderColor_ = color; }
+
+	// Charger une image comme texture (voir Texture::loadFromImage). isSrgb indique que les pixels sont des couleurs encodées en sRGB, à filtrer dans l'espace linéaire pour les niveaux de détail; il faut le désactiver pour les données (normales, hauteurs, etc.). Doit être appelée dans le fil du contexte OpenGL, pour créer la texture de remplacement.
+	AssetHandle<Texture> loadTexture(const std::string& filename, int detailLevels = 1, bool isSrgb = true) {
+		auto slot = std::make_shared<AssetHandle<Texture>::Slot>();
+		slot->resource = getPlaceholderTexture();
+		queue_->addPending();
+		pool_->submit([queue = queue_, slot, filename, detailLevels, isSrgb]() {
+			auto image = std::make_shared<sf::Image>();
+			if (not image->loadFromFile(filename)) {
+				std::cerr << "ERROR " << filename << " could not be loaded" << "\n";
+				queue->push({0, [slot](size_t&) { fail(*slot); return true; }, [slot]() { fail(*slot); }});
+				return;
+			}
+			// L'image est renversée ici, hors du fil principal, pour que chaque bande de rangées soit envoyée d'un seul appel (voir Texture::setPixelRowsFlipped). Les niveaux de détail sont aussi calculés ici, dans le fil de cette tâche (on ne peut pas utiliser parallelFor à partir d'une tâche du bassin).
+			image->flipVertically();
+			ivec2 size = {image->getSize().x, image->getSize().y};
+			auto mipLevels = std::make_shared<std::vector<MipLevel>>(generateMipmapChain(image->getPixelsPtr(), size, detailLevels, isSrgb, nullptr));
+			size_t numBytes = Texture::computeByteSize(size, int(mipLevels->size()) + 1);
+			auto texture = std::make_shared<Texture>();
+			auto fence = queue->submitToUploadThread([image, mipLevels, texture, size, detailLevels]() {
+				*texture = Texture::create(size, detailLevels);
+				texture->setPixelRect(0, {0, 0}, size, GL_RGBA, image->getPixelsPtr());
+				texture->setMipLevels(*mipLevels, false);
+			});
+			if (fence.valid()) {
+				queue->push({numBytes, [slot, texture, fence, filename](size_t&) {
+					if (not isFutureReady(fence))
+						return false;
+					UploadThread::waitForFence(fence.get());
+					GpuMemoryRegistry::getDefault().setName(GpuMemoryCategory::Texture, texture->id, filename);
+					publish(*slot, std::move(*texture));
+					return true;
+				}, [slot, texture, fence]() {
+					UploadThread::waitForFence(fence.get());
+					texture->deleteObject();
+					fail(*slot);
+				}});
+				return;
+			}
+
+			// Les niveaux sont envoyés un après l'autre, chacun en bandes de rangées.
+			auto next = std::make_shared<ivec2>(0, 0); // Niveau et rangée.
+			queue->push({numBytes, [slot, image, mipLevels, texture, next, size, detailLevels, filename](size_t& budget) {
+				if (texture->id == 0)
+					*texture = Texture::create(size, detailLevels);
+				while (next->x <= (int)mipLevels->size()) {
+					int level = next->x;
+					ivec2 levelSize = level == 0 ? size : (*mipLevels)[level - 1].size;
+					const uint8_t* pixels = level == 0 ? image->getPixelsPtr() : (*mipLevels)[level - 1].pixels.data();
+					size_t rowSize = size_t(levelSize.x) * 4;
+					// Envoyer autant de rangées que le budget le permet, au moins une pour toujours avancer.
+					int numRows = std::clamp(int(budget / rowSize), 1, levelSize.y - next->y);
+					texture->setPixelRect(level, {0, next->y}, {levelSize.x, numRows}, GL_RGBA, pixels + next->y * rowSize);
+					next->y += numRows;
+					budget -= std::min(budget, numRows * rowSize);
+					if (next->y == levelSize.y)
+						*next = {level + 1, 0};
+					if (budget == 0 and next->x <= (int)mipLevels->size())
+						return false;
+				}
+				GpuMemoryRegistry::getDefault().setName(GpuMemoryCategory::Texture, texture->id, filename);
+				publish(*slot, std::move(*texture));
+				return true;
+			}, [slot, texture]() {
+				// La texture a pu être créée et en partie remplie par les trames précédentes.
+				if (texture->id != 0)
+					texture->deleteObject();
+				fail(*slot);
+			}});
+		});
+		return {slot};
+	}
+
+	// Charger les objets d'un fichier Wavefront (voir BasicMesh::loadFromWavefrontFile). Le mesh est vide en attendant.
+	template <typename Vertex = VertexData>
+	AssetHandle<std::vector<BasicMesh<Vertex>>> loadMeshes(const std::string& filename, bool weldVertices = false, bool generateNormals = false) {
+		using Meshes = std::vector<BasicMesh<Vertex>>;
+		auto slot = std::make_shared<typename AssetHandle<Meshes>::Slot>();
+		queue_->addPending();
+		pool_->submit([queue = queue_, slot, filename, weldVertices, generateNormals]() {
+			// On utilise tinyobj plutôt que loadFromWavefrontFileParallel, qui attendrait des tâches du même bassin. Pour la même raison, le calcul des normales et des tangentes est fait dans le fil de cette tâche (loadFromWavefrontFile ne passe pas de bassin à computeNormals et computeTangents).
+			auto meshes = std::make_shared<Meshes>(BasicMesh<Vertex>::loadFromWavefrontFile(filename, false, weldVertices, generateNormals));
+			if (meshes->empty()) {
+				queue->push({0, [slot](size_t&) { fail(*slot); return true; }, [slot]() { fail(*slot); }});
+				return;
+			}
+			// Les tampons d'un mesh sont envoyés d'un coup : on compte leur taille dans le budget, mais on ne les sépare pas.
+			size_t numBytes = 0;
+			for (auto&& mesh : *meshes)
+				numBytes += mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(GLuint);
+			auto fence = queue->submitToUploadThread([meshes]() {
+				for (auto&& mesh : *meshes)
+					mesh.uploadBuffers();
+			});
+			if (fence.valid()) {
+				queue->push({numBytes, [slot, meshes, fence](size_t&) {
+					if (not isFutureReady(fence))
+						return false;
+					UploadThread::waitForFence(fence.get());
+					for (auto&& mesh : *meshes)
+						mesh.setupVao();
+					publish(*slot, std::move(*meshes));
+					return true;
+				}, [slot, meshes, fence]() {
+					// Les tampons ont été créés par le fil d'envoi, mais pas encore le VAO.
+					UploadThread::waitForFence(fence.get());
+					for (auto&& mesh : *meshes)
+						mesh.deleteObjects();
+					fail(*slot);
+				}});
+				return;
+			}
+			queue->push({numBytes, [slot, meshes, numBytes](size_t& budget) {
+				for (auto&& mesh : *meshes)
+					mesh.setup();
+				budget -= std::min(budget, numBytes);
+				publish(*slot, std::move(*meshes));
+				return true;
+			}, [slot]() { fail(*slot); }});
+		});
+		return {slot};
+	}
+
+	// Faire les envois en mémoire graphique en attente, jusqu'à environ budgetBytes octets (au moins un envoi par appel pour toujours avancer). Doit être appelée dans le fil du contexte OpenGL. Retourne le nombre d'octets envoyés.
+	size_t processUploads(size_t budgetBytes) {
+		size_t budget = budgetBytes;
+		while (true) {
+			std::function<bool(size_t&)> upload;
+			{
+				std::lock_guard lock(queue_->mutex);
+				if (queue_->uploads.empty())
+					break;
+				upload = queue_->uploads.front().upload;
+			}
+			// L'envoi n'est retiré de la file que lorsqu'il est terminé; sinon c'est que le budget est épuisé et on le reprendra à la prochaine trame.
+			if (not upload(budget))
+				break;
+			{
+				std::lock_guard lock(queue_->mutex);
+				queue_->uploads.pop_front();
+				queue_->numPending--;
+			}
+			if (budget == 0)
+				break;
+		}
+		return budgetBytes - budget;
+	}
+
+	// Nombre de ressources pas encore prêtes (en décodage ou en attente d'envoi).
+	size_t getNumPending() const {
+		std::lock_guard lock(queue_->mutex);
+		return queue_->numPending;
+	}
+
+	// Octets décodés qui attendent d'être envoyés en mémoire graphique.
+	size_t getPendingUploadBytes() const {
+		std::lock_guard lock(queue_->mutex);
+		size_t total = 0;
+		for (auto&& upload : queue_->uploads)
+			total += upload.numBytes;
+		return total;
+	}
+
+	// Libérer la texture de remplacement et les ressources qui n'ont pas encore été publiées (en attente d'envoi ou envoyées en partie); leurs handles passent à l'état Failed. Doit être appelée dans le fil du contexte OpenGL, après l'arrêt du fil d'envoi (voir OpenGLApplication). On attend d'abord la fin des décodages en cours, pour qu'aucun envoi ne soit ajouté à la file après.
+	void deleteObjects() {
+		std::deque<PendingUpload> uploads;
+		{
+			std::unique_lock lock(queue_->mutex);
+			queue_->decodingDone.wait(lock, [this]() { return queue_->numDecoding == 0; });
+			uploads.swap(queue_->uploads);
+			queue_->numPending = 0;
+		}
+		for (auto&& upload : uploads)
+			upload.discard();
+		placeholderTexture_.deleteObject();
+	}
+
+private:
+	struct PendingUpload
+	{
+		size_t numBytes;
+		// Appelée dans le fil principal avec le budget restant, qu'elle décrémente. Retourne vrai quand l'envoi est terminé.
+		std::function<bool(size_t&)> upload;
+		// Appelée par deleteObjects à la place de l'envoi : libère ce qui a déjà été créé en mémoire graphique.
+		std::function<void()> discard;
+	};
+
+	// Partagée avec les tâches de décodage, qui peuvent finir après la destruction du chargeur.
+	struct UploadQueue
+	{
+		mutable std::mutex mutex;
+		std::deque<PendingUpload> uploads;
+		size_t numPending = 0;
+		// Tâches de décodage pas encore terminées. Chacune finit en ajoutant exactement un envoi à la file.
+		size_t numDecoding = 0;
+		std::condition_variable decodingDone;
+
+		UploadThread* uploadThread = nullptr;
+
+		// Soumettre un envoi au fil d'envoi. Retourne un futur invalide s'il n'y en a pas (ou plus) : l'envoi doit alors se faire dans processUploads.
+		template <typename Func>
+		std::shared_future<GLsync> submitToUploadThread(Func&& func) {
+			std::lock_guard lock(mutex);
+			if (uploadThread == nullptr)
+				return {};
+			return uploadThread->submit(std::forward<Func>(func)).share();
+		}
+
+		void addPending() {
+			std::lock_guard lock(mutex);
+			numPending++;
+			numDecoding++;
+		}
+
+		void push(PendingUpload upload) {
+			{
+				std::lock_guard lock(mutex);
+				uploads.push_back(std::move(upload));
+				numDecoding--;
+			}
+			decodingDone.notify_all();
+		}
+	};
+
+	template <typename Slot, typename Resource>
+	static void publish(Slot& slot, Resource&& resource) {
+		slot.resource = std::move(resource);
+		slot.state = AssetState::Ready;
+		slot.promise.set_value(true);
+	}
+
+	static bool isFutureReady(const std::shared_future<GLsync>& future) {
+		return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	template <typename Slot>
+	static void fail(Slot& slot) {
+		slot.state = AssetState::Failed;
+		slot.promise.set_value(false);
+	}
+
+	const Texture& getPlaceholderTexture() {
+		if (placeholderTexture_.id == 0)
+			placeholderTexture_ = Texture::createFromColor(placeholderColor_);
+		return placeholderTexture_;
+	}
+
+	ThreadPool* pool_;
+	std::shared_ptr<UploadQueue> queue_;
+	Texture placeholderTexture_;
+	vec4 placeholderColor_ = {0.5f, 0.5f, 0.5f, 1};
+};
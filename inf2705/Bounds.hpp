@@ -0,0 +1,77 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+
+using namespace glm;
+
+
+// Boîte englobante alignée sur les axes (AABB). Une boîte vide a minPos > maxPos.
+struct BoundingBox
+{
+	vec3 minPos = vec3(FLT_MAX);
+	vec3 maxPos = vec3(-FLT_MAX);
+
+	bool isEmpty() const { return minPos.x > maxPos.x; }
+	vec3 getCenter() const { return (minPos + maxPos) * 0.5f; }
+	vec3 getExtents() const { return (maxPos - minPos) * 0.5f; }
+
+	void expand(vec3 point) {
+		minPos = glm::min(minPos, point);
+		maxPos = glm::max(maxPos, point);
+	}
+
+	// La boîte (alignée sur les nouveaux axes) qui contient la boîte transformée. Plutôt que de transformer les 8 coins, on transforme le centre et on projette les demi-côtés avec la valeur absolue de la matrice (Arvo, « Transforming Axis-Aligned Bounding Boxes », Graphics Gems 1990).
+	BoundingBox transformed(const mat4& m) const {
+		if (isEmpty())
+			return {};
+		vec3 center = vec3(m * vec4(getCenter(), 1));
+		mat3 absM = mat3(glm::abs(vec3(m[0])), glm::abs(vec3(m[1])), glm::abs(vec3(m[2])));
+		vec3 extents = absM * getExtents();
+		return {center - extents, center + extents};
+	}
+};
+
+// Sphère englobante. Une sphère vide a un rayon négatif.
+struct BoundingSphere
+{
+	vec3 center = {};
+	float radius = -1;
+
+	bool isEmpty() const { return radius < 0; }
+
+	// La sphère qui contient la sphère transformée : le rayon est multiplié par le plus grand facteur d'échelle de la matrice.
+	BoundingSphere transformed(const mat4& m) const {
+		if (isEmpty())
+			return {};
+		float scale2 = std::max({dot(vec3(m[0]), vec3(m[0])), dot(vec3(m[1]), vec3(m[1])), dot(vec3(m[2]), vec3(m[2]))});
+		return {vec3(m * vec4(center, 1)), radius * std::sqrt(scale2)};
+	}
+};
+
+// Calculer la boîte et la sphère englobantes d'une suite de positions. getPosition(i) doit retourner la position (vec3) du i-ème point. La sphère est centrée sur la boîte, ce qui n'est pas optimal mais est simple et rapide.
+template <typename GetPosition>
+inline void computeBounds(size_t numPoints, GetPosition&& getPosition, BoundingBox& box, BoundingSphere& sphere) {
+	box = {};
+	sphere = {};
+	for (size_t i = 0; i < numPoints; i++)
+		box.expand(getPosition(i));
+	if (box.isEmpty())
+		return;
+
+	sphere.center = box.getCenter();
+	float maxDistance2 = 0;
+	for (size_t i = 0; i < numPoints; i++) {
+		vec3 d = getPosition(i) - sphere.center;
+		maxDistance2 = std::max(maxDistance2, dot(d, d));
+	}
+	sphere.radius = std::sqrt(maxDistance2);
+}
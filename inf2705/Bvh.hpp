@@ -0,0 +1,454 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Bounds.hpp"
+#include "Mesh.hpp"
+#include "sfml_utils.hpp"
+
+
+using namespace glm;
+
+
+// Un rayon origin + t * direction. La direction n'est pas forcément unitaire : un rayon transformé dans l'espace d'un objet garde ainsi le même paramètre t que dans l'espace du monde.
+struct Ray
+{
+	vec3 origin = {};
+	vec3 direction = {0, 0, -1};
+
+	vec3 getPoint(float t) const { return origin + t * direction; }
+
+	Ray transformed(const mat4& m) const {
+		return {vec3(m * vec4(origin, 1)), vec3(m * vec4(direction, 0))};
+	}
+
+	// Le rayon qui part du plan proche et passe par un point en coordonnées normalisées ([-1,1], y vers le haut), dans l'espace du monde. On « dé-projette » les points correspondants sur les plans proche et lointain avec l'inverse de projection * visualisation.
+	static Ray fromNormalizedCoords(vec2 ndc, const mat4& view, const mat4& projection) {
+		mat4 inverseViewProjection = inverse(projection * view);
+		vec4 nearPoint = inverseViewProjection * vec4(ndc.x, ndc.y, -1, 1);
+		vec4 farPoint = inverseViewProjection * vec4(ndc.x, ndc.y, 1, 1);
+		vec3 origin = vec3(nearPoint) / nearPoint.w;
+		return {origin, normalize(vec3(farPoint) / farPoint.w - origin)};
+	}
+
+	static Ray fromMouse(const MouseState& mouse, const mat4& view, const mat4& projection) {
+		return fromNormalizedCoords({mouse.normalized.x, mouse.normalized.y}, view, projection);
+	}
+};
+
+// Le résultat d'un lancer de rayon. Le point touché est (1 - u - v) * p0 + u * p1 + v * p2, où (u, v) sont les coordonnées barycentriques et p0, p1, p2 les coins du triangle.
+struct RayHit
+{
+	float distance = FLT_MAX; // Le paramètre t du rayon.
+	uint32_t triangle = UINT32_MAX; // Indice du triangle dans le mesh (triangle i = indices 3i à 3i+2).
+	vec2 barycentrics = {};
+	uint32_t instance = UINT32_MAX; // Indice de l'instance dans la SceneBvh, s'il y a lieu.
+
+	bool isHit() const { return triangle != UINT32_MAX; }
+};
+
+// Un nœud de BVH sur 32 octets (deux nœuds par ligne de cache). Une feuille (count > 0) contient les primitives [leftOrFirst, leftOrFirst + count); un nœud interne a ses deux enfants côte à côte à leftOrFirst et leftOrFirst + 1.
+struct BvhNode
+{
+	vec3 boundsMin;
+	uint32_t leftOrFirst = 0;
+	vec3 boundsMax;
+	uint32_t count = 0;
+
+	bool isLeaf() const { return count > 0; }
+};
+
+static_assert(sizeof(BvhNode) == 32);
+
+// Intersection rayon-boîte par la méthode des tranches (slabs). Retourne la distance d'entrée, ou FLT_MAX si le rayon manque la boîte ou l'atteint après maxDistance.
+inline float intersectRayBox(const Ray& ray, vec3 inverseDirection, vec3 boundsMin, vec3 boundsMax, float maxDistance) {
+	vec3 t1 = (boundsMin - ray.origin) * inverseDirection;
+	vec3 t2 = (boundsMax - ray.origin) * inverseDirection;
+	vec3 tNear = glm::min(t1, t2);
+	vec3 tFar = glm::max(t1, t2);
+	float entry = std::max({tNear.x, tNear.y, tNear.z, 0.0f});
+	float exit = std::min({tFar.x, tFar.y, tFar.z, maxDistance});
+	return entry <= exit ? entry : FLT_MAX;
+}
+
+// Intersection rayon-triangle de Möller et Trumbore. Met à jour hit si le triangle est plus proche.
+inline bool intersectRayTriangle(const Ray& ray, vec3 p0, vec3 p1, vec3 p2, RayHit& hit) {
+	vec3 edge1 = p1 - p0;
+	vec3 edge2 = p2 - p0;
+	vec3 h = cross(ray.direction, edge2);
+	float det = dot(edge1, h);
+	if (std::abs(det) < 1e-12f)
+		return false;
+	float invDet = 1 / det;
+	vec3 s = ray.origin - p0;
+	float u = invDet * dot(s, h);
+	if (u < 0 or u > 1)
+		return false;
+	vec3 q = cross(s, edge1);
+	float v = invDet * dot(ray.direction, q);
+	if (v < 0 or u + v > 1)
+		return false;
+	float t = invDet * dot(edge2, q);
+	if (t <= 0 or t >= hit.distance)
+		return false;
+	hit.distance = t;
+	hit.barycentrics = {u, v};
+	return true;
+}
+
+// Construire une BVH avec l'heuristique de surface (SAH) par compartiments : pour chaque nœud, on répartit les centres des primitives dans numBins compartiments sur chaque axe et on choisit la coupe qui minimise aire(gauche) * n(gauche) + aire(droite) * n(droite), soit le coût attendu d'un rayon qui traverse le nœud. C'est presque aussi bon qu'un SAH exact et beaucoup plus rapide à construire.
+// primOrder reçoit l'ordre des primitives : les feuilles font référence à des plages de ce tableau. Les nœuds sont créés parents avant enfants, ce que refitBvh utilise.
+inline void buildBvh(const std::vector<BoundingBox>& primBounds, std::vector<BvhNode>& nodes, std::vector<uint32_t>& primOrder, uint32_t maxLeafSize = 4) {
+	constexpr int numBins = 12;
+	size_t numPrims = primBounds.size();
+	nodes.clear();
+	primOrder.resize(numPrims);
+	for (uint32_t i = 0; i < numPrims; i++)
+		primOrder[i] = i;
+	if (numPrims == 0)
+		return;
+	nodes.reserve(2 * numPrims);
+
+	std::vector<vec3> centroids(numPrims);
+	for (size_t i = 0; i < numPrims; i++)
+		centroids[i] = primBounds[i].getCenter();
+
+	auto surfaceArea = [](const BoundingBox& box) {
+		if (box.isEmpty())
+			return 0.0f;
+		vec3 d = box.maxPos - box.minPos;
+		return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+	};
+
+	nodes.push_back({});
+	nodes[0].count = (uint32_t)numPrims;
+	std::vector<uint32_t> pending = {0};
+	while (not pending.empty()) {
+		uint32_t nodeIndex = pending.back();
+		pending.pop_back();
+		uint32_t first = nodes[nodeIndex].leftOrFirst;
+		uint32_t count = nodes[nodeIndex].count;
+
+		BoundingBox bounds;
+		BoundingBox centroidBounds;
+		for (uint32_t i = first; i < first + count; i++) {
+			bounds.expand(primBounds[primOrder[i]].minPos);
+			bounds.expand(primBounds[primOrder[i]].maxPos);
+			centroidBounds.expand(centroids[primOrder[i]]);
+		}
+		nodes[nodeIndex].boundsMin = bounds.minPos;
+		nodes[nodeIndex].boundsMax = bounds.maxPos;
+		if (count <= maxLeafSize)
+			continue;
+
+		// Trouver la meilleure coupe sur les trois axes.
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		int bestSplit = 0;
+		vec3 extent = centroidBounds.maxPos - centroidBounds.minPos;
+		for (int axis = 0; axis < 3; axis++) {
+			if (extent[axis] <= 0)
+				continue;
+			std::array<BoundingBox, numBins> binBounds;
+			std::array<uint32_t, numBins> binCounts = {};
+			float scale = numBins / extent[axis];
+			for (uint32_t i = first; i < first + count; i++) {
+				uint32_t prim = primOrder[i];
+				int bin = std::min(numBins - 1, int((centroids[prim][axis] - centroidBounds.minPos[axis]) * scale));
+				binCounts[bin]++;
+				binBounds[bin].expand(primBounds[prim].minPos);
+				binBounds[bin].expand(primBounds[prim].maxPos);
+			}
+			// Balayer de gauche à droite puis de droite à gauche pour avoir le coût de chaque coupe en temps linéaire.
+			std::array<float, numBins - 1> leftCosts;
+			BoundingBox accumulated;
+			uint32_t accumulatedCount = 0;
+			for (int b = 0; b < numBins - 1; b++) {
+				accumulatedCount += binCounts[b];
+				if (binCounts[b] != 0) {
+					accumulated.expand(binBounds[b].minPos);
+					accumulated.expand(binBounds[b].maxPos);
+				}
+				leftCosts[b] = surfaceArea(accumulated) * accumulatedCount;
+			}
+			accumulated = {};
+			accumulatedCount = 0;
+			for (int b = numBins - 1; b > 0; b--) {
+				accumulatedCount += binCounts[b];
+				if (binCounts[b] != 0) {
+					accumulated.expand(binBounds[b].minPos);
+					accumulated.expand(binBounds[b].maxPos);
+				}
+				float cost = leftCosts[b - 1] + surfaceArea(accumulated) * accumulatedCount;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		// Toutes les primitives au même centre : on ne peut pas les séparer.
+		if (bestAxis < 0)
+			continue;
+		// Ne pas couper si une feuille coûte moins cher que la meilleure coupe (à moins que la feuille soit trop grosse).
+		float leafCost = surfaceArea(bounds) * count;
+		if (bestCost >= leafCost and count <= 4 * maxLeafSize)
+			continue;
+
+		float scale = numBins / extent[bestAxis];
+		auto middle = std::partition(primOrder.begin() + first, primOrder.begin() + first + count, [&](uint32_t prim) {
+			int bin = std::min(numBins - 1, int((centroids[prim][bestAxis] - centroidBounds.minPos[bestAxis]) * scale));
+			return bin < bestSplit;
+		});
+		uint32_t leftCount = uint32_t(middle - primOrder.begin()) - first;
+		if (leftCount == 0 or leftCount == count)
+			continue;
+
+		uint32_t leftIndex = (uint32_t)nodes.size();
+		nodes.push_back({});
+		nodes.push_back({});
+		nodes[leftIndex].leftOrFirst = first;
+		nodes[leftIndex].count = leftCount;
+		nodes[leftIndex + 1].leftOrFirst = first + leftCount;
+		nodes[leftIndex + 1].count = count - leftCount;
+		nodes[nodeIndex].leftOrFirst = leftIndex;
+		nodes[nodeIndex].count = 0;
+		pending.push_back(leftIndex);
+		pending.push_back(leftIndex + 1);
+	}
+}
+
+// Recalculer les boîtes des nœuds sans changer la structure de l'arbre, pour des primitives qui ont bougé. Les enfants sont toujours après leur parent, il suffit donc de parcourir les nœuds à l'envers. L'arbre devient moins efficace si les primitives bougent beaucoup, il vaut alors mieux le reconstruire.
+// getPrimBounds(i) doit retourner la BoundingBox de la i-ème primitive de primOrder.
+template <typename GetPrimBounds>
+inline void refitBvh(std::vector<BvhNode>& nodes, GetPrimBounds&& getPrimBounds) {
+	for (size_t n = nodes.size(); n-- > 0;) {
+		auto& node = nodes[n];
+		BoundingBox bounds;
+		if (node.isLeaf()) {
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+				BoundingBox prim = getPrimBounds(i);
+				bounds.expand(prim.minPos);
+				bounds.expand(prim.maxPos);
+			}
+		} else {
+			for (uint32_t child : {node.leftOrFirst, node.leftOrFirst + 1}) {
+				bounds.expand(nodes[child].boundsMin);
+				bounds.expand(nodes[child].boundsMax);
+			}
+		}
+		node.boundsMin = bounds.minPos;
+		node.boundsMax = bounds.maxPos;
+	}
+}
+
+// Parcourir une BVH en visitant l'enfant le plus proche en premier. intersectLeaf(first, count, hit) teste les primitives d'une feuille et met à jour hit.distance, ce qui élague les nœuds plus loin.
+template <typename IntersectLeaf>
+inline void traverseBvh(const std::vector<BvhNode>& nodes, const Ray& ray, RayHit& hit, IntersectLeaf&& intersectLeaf) {
+	if (nodes.empty())
+		return;
+	vec3 inverseDirection = 1.0f / ray.direction;
+	if (intersectRayBox(ray, inverseDirection, nodes[0].boundsMin, nodes[0].boundsMax, hit.distance) == FLT_MAX)
+		return;
+
+	// La profondeur d'une BVH SAH reste normalement bien en deçà de 64 : la pile tient sur la pile d'exécution. Un arbre très déséquilibré (primitives à des échelles très différentes) peut être plus profond; les nœuds en trop vont alors dans un vecteur plutôt que d'être perdus.
+	constexpr int maxStackSize = 64;
+	uint32_t stack[maxStackSize];
+	int stackSize = 0;
+	std::vector<uint32_t> overflow;
+	uint32_t current = 0;
+	while (true) {
+		const BvhNode& node = nodes[current];
+		if (node.isLeaf()) {
+			intersectLeaf(node.leftOrFirst, node.count, hit);
+		} else {
+			uint32_t near = node.leftOrFirst;
+			uint32_t far = node.leftOrFirst + 1;
+			float nearDistance = intersectRayBox(ray, inverseDirection, nodes[near].boundsMin, nodes[near].boundsMax, hit.distance);
+			float farDistance = intersectRayBox(ray, inverseDirection, nodes[far].boundsMin, nodes[far].boundsMax, hit.distance);
+			if (farDistance < nearDistance) {
+				std::swap(near, far);
+				std::swap(nearDistance, farDistance);
+			}
+			if (nearDistance != FLT_MAX) {
+				if (farDistance != FLT_MAX) {
+					if (stackSize < maxStackSize)
+						stack[stackSize++] = far;
+					else
+						overflow.push_back(far);
+				}
+				current = near;
+				continue;
+			}
+		}
+		// Les nœuds du vecteur ont été empilés après ceux du tableau, ils sortent donc en premier.
+		if (not overflow.empty()) {
+			current = overflow.back();
+			overflow.pop_back();
+		} else if (stackSize != 0) {
+			current = stack[--stackSize];
+		} else {
+			break;
+		}
+	}
+}
+
+// BVH sur les triangles d'un mesh, pour le lancer de rayons (sélection à la souris par exemple). On garde une copie des positions des coins de chaque triangle dans l'ordre des feuilles : une feuille lit donc un bloc contigu de mémoire.
+class TriangleBvh
+{
+public:
+	template <typename Vertex>
+	void build(const BasicMesh<Vertex>& mesh, uint32_t maxLeafSize = 4) {
+		size_t numTriangles = getNumTriangles(mesh);
+		std::vector<BoundingBox> triangleBounds(numTriangles);
+		for (size_t t = 0; t < numTriangles; t++) {
+			for (int c = 0; c < 3; c++)
+				triangleBounds[t].expand(getCorner(mesh, t, c));
+		}
+		buildBvh(triangleBounds, nodes_, triangleIds_, maxLeafSize);
+		copyCorners(mesh);
+	}
+
+	// Mettre à jour l'arbre pour un mesh dont les positions ont changé (mais pas la connectivité).
+	template <typename Vertex>
+	void refit(const BasicMesh<Vertex>& mesh) {
+		copyCorners(mesh);
+		refitBvh(nodes_, [this](uint32_t i) {
+			BoundingBox box;
+			for (int c = 0; c < 3; c++)
+				box.expand(corners_[i * 3 + c]);
+			return box;
+		});
+	}
+
+	// Le rayon doit être dans l'espace de l'objet. On garde le triangle le plus proche avant hit.distance.
+	bool intersect(const Ray& ray, RayHit& hit) const {
+		bool isHit = false;
+		traverseBvh(nodes_, ray, hit, [&](uint32_t first, uint32_t count, RayHit& leafHit) {
+			for (uint32_t i = first; i < first + count; i++) {
+				if (intersectRayTriangle(ray, corners_[i * 3 + 0], corners_[i * 3 + 1], corners_[i * 3 + 2], leafHit)) {
+					leafHit.triangle = triangleIds_[i];
+					isHit = true;
+				}
+			}
+		});
+		return isHit;
+	}
+
+	BoundingBox getBounds() const {
+		if (nodes_.empty())
+			return {};
+		return {nodes_[0].boundsMin, nodes_[0].boundsMax};
+	}
+
+	const std::vector<BvhNode>& getNodes() const { return nodes_; }
+
+private:
+	// Un mesh sans tableau d'indices a simplement trois sommets à la suite par triangle.
+	template <typename Vertex>
+	static size_t getNumTriangles(const BasicMesh<Vertex>& mesh) {
+		return mesh.indices.empty() ? mesh.vertices.size() / 3 : mesh.indices.size() / 3;
+	}
+
+	template <typename Vertex>
+	static vec3 getCorner(const BasicMesh<Vertex>& mesh, size_t triangle, int corner) {
+		size_t i = triangle * 3 + corner;
+		return mesh.vertices[mesh.indices.empty() ? i : mesh.indices[i]].position;
+	}
+
+	template <typename Vertex>
+	void copyCorners(const BasicMesh<Vertex>& mesh) {
+		corners_.resize(triangleIds_.size() * 3);
+		for (size_t i = 0; i < triangleIds_.size(); i++) {
+			for (int c = 0; c < 3; c++)
+				corners_[i * 3 + c] = getCorner(mesh, triangleIds_[i], c);
+		}
+	}
+
+	std::vector<BvhNode> nodes_;
+	std::vector<uint32_t> triangleIds_; // Le triangle d'origine de chaque triangle dans l'ordre des feuilles.
+	std::vector<vec3> corners_;
+};
+
+// BVH de deuxième niveau sur des instances de TriangleBvh placées dans la scène avec une matrice de modélisation. Plusieurs instances peuvent partager la même TriangleBvh. Quand des instances bougent, on change leur matrice avec setTransform puis on appelle refit() (ou build() si elles ont beaucoup bougé).
+class SceneBvh
+{
+public:
+	struct Instance
+	{
+		const TriangleBvh* bvh = nullptr;
+		mat4 model = mat4(1);
+		mat4 inverseModel = mat4(1);
+		BoundingBox worldBounds;
+	};
+
+	uint32_t addInstance(const TriangleBvh& bvh, const mat4& model) {
+		instances_.push_back({&bvh, mat4(1), mat4(1), {}});
+		setTransform(uint32_t(instances_.size() - 1), model);
+		return uint32_t(instances_.size() - 1);
+	}
+
+	void setTransform(uint32_t instance, const mat4& model) {
+		auto& inst = instances_[instance];
+		inst.model = model;
+		inst.inverseModel = inverse(model);
+		inst.worldBounds = inst.bvh->getBounds().transformed(model);
+	}
+
+	void clear() {
+		instances_.clear();
+		nodes_.clear();
+		instanceOrder_.clear();
+	}
+
+	void build() {
+		std::vector<BoundingBox> bounds(instances_.size());
+		for (size_t i = 0; i < instances_.size(); i++)
+			bounds[i] = instances_[i].worldBounds;
+		buildBvh(bounds, nodes_, instanceOrder_, 1);
+	}
+
+	// Aussi nécessaire après le refit d'une TriangleBvh utilisée par une instance.
+	void refit() {
+		for (uint32_t i = 0; i < instances_.size(); i++)
+			setTransform(i, instances_[i].model);
+		refitBvh(nodes_, [this](uint32_t i) { return instances_[instanceOrder_[i]].worldBounds; });
+	}
+
+	// Le rayon est dans l'espace du monde. Pour chaque instance atteinte, on le transforme dans l'espace de l'objet sans le normaliser, pour que les distances restent comparables entre instances.
+	RayHit intersect(const Ray& ray) const {
+		RayHit hit;
+		traverseBvh(nodes_, ray, hit, [&](uint32_t first, uint32_t count, RayHit& leafHit) {
+			for (uint32_t i = first; i < first + count; i++) {
+				uint32_t instance = instanceOrder_[i];
+				auto& inst = instances_[instance];
+				if (inst.bvh->intersect(ray.transformed(inst.inverseModel), leafHit))
+					leafHit.instance = instance;
+			}
+		});
+		return hit;
+	}
+
+	// Trouver ce qui est sous le curseur de la souris.
+	RayHit pick(const MouseState& mouse, const mat4& view, const mat4& projection) const {
+		return intersect(Ray::fromMouse(mouse, view, projection));
+	}
+
+	const std::vector<Instance>& getInstances() const { return instances_; }
+
+private:
+	std::vector<Instance> instances_;
+	std::vector<BvhNode> nodes_;
+	std::vector<uint32_t> instanceOrder_;
+};
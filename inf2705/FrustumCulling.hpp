@@ -0,0 +1,183 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) or defined(_M_X64) or (defined(_M_IX86_FP) and _M_IX86_FP >= 2)
+	#define INF2705_HAS_SSE2
+	#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Bounds.hpp"
+
+
+using namespace glm;
+
+
+// Les six plans du volume de vision. Chaque plan est (a, b, c, d) avec la normale (a, b, c) unitaire et pointant vers l'intérieur : un point p est du bon côté si dot(normal, p) + d >= 0.
+struct Frustum
+{
+	enum Plane { Left, Right, Bottom, Top, Near, Far };
+
+	std::array<vec4, 6> planes;
+
+	// Extraire les plans d'une matrice projection * visualisation (Gribb et Hartmann, « Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix », 2001). Un point est visible si -w <= x, y, z <= w après la transformation, et chacune de ces inégalités est un plan dans l'espace d'avant la transformation. Avec projection * visualisation, on obtient les plans dans l'espace du monde; en ajoutant la modélisation, dans l'espace de l'objet.
+	static Frustum fromMatrix(const mat4& m) {
+		// glm est en colonnes, la rangée i est donc formée du i-ème élément de chaque colonne.
+		auto row = [&](int i) { return vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+		Frustum frustum;
+		frustum.planes[Left] = row(3) + row(0);
+		frustum.planes[Right] = row(3) - row(0);
+		frustum.planes[Bottom] = row(3) + row(1);
+		frustum.planes[Top] = row(3) - row(1);
+		frustum.planes[Near] = row(3) + row(2);
+		frustum.planes[Far] = row(3) - row(2);
+		for (auto&& plane : frustum.planes)
+			plane /= length(vec3(plane));
+		return frustum;
+	}
+
+	bool intersects(const BoundingSphere& sphere) const {
+		for (auto&& plane : planes) {
+			if (dot(vec3(plane), sphere.center) + plane.w < -sphere.radius)
+				return false;
+		}
+		return true;
+	}
+
+	// Pour une boîte, on teste seulement le coin le plus loin dans la direction de la normale : si même lui est derrière un plan, toute la boîte l'est.
+	bool intersects(const BoundingBox& box) const {
+		vec3 center = box.getCenter();
+		vec3 extents = box.getExtents();
+		for (auto&& plane : planes) {
+			vec3 normal = vec3(plane);
+			if (dot(normal, center) + dot(glm::abs(normal), extents) + plane.w < 0)
+				return false;
+		}
+		return true;
+	}
+};
+
+// Une liste de sphères englobantes (typiquement dans l'espace du monde) en disposition SoA : un tableau par composante plutôt qu'un tableau de BoundingSphere. On peut alors charger 4 ou 8 sphères d'un coup dans un registre SIMD.
+struct BoundingSphereList
+{
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+
+	size_t size() const { return radius.size(); }
+
+	void clear() {
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		radius.clear();
+	}
+
+	void reserve(size_t n) {
+		centerX.reserve(n);
+		centerY.reserve(n);
+		centerZ.reserve(n);
+		radius.reserve(n);
+	}
+
+	void push_back(const BoundingSphere& sphere) {
+		centerX.push_back(sphere.center.x);
+		centerY.push_back(sphere.center.y);
+		centerZ.push_back(sphere.center.z);
+		radius.push_back(sphere.radius);
+	}
+
+	void set(size_t i, const BoundingSphere& sphere) {
+		centerX[i] = sphere.center.x;
+		centerY[i] = sphere.center.y;
+		centerZ[i] = sphere.center.z;
+		radius[i] = sphere.radius;
+	}
+};
+
+// Tester toutes les sphères de la liste contre le volume de vision et mettre les indices de celles qui sont (au moins partiellement) visibles dans visibleIndices, dans l'ordre et sans trous.
+// On teste 8 sphères à la fois avec AVX (si le code est compilé avec AVX, par exemple -mavx ou /arch:AVX), sinon 4 à la fois avec SSE (toujours disponible en x86-64), et le reste une à la fois. Le masque des résultats (movemask) donne directement les sphères visibles, ce qui évite un branchement par sphère.
+inline void cullSpheres(const Frustum& frustum, const BoundingSphereList& spheres, std::vector<uint32_t>& visibleIndices) {
+	size_t n = spheres.size();
+	// Réserver le pire cas et écrire directement, puis réduire à la fin.
+	visibleIndices.resize(n);
+	uint32_t* out = visibleIndices.data();
+	size_t numVisible = 0;
+	const float* cx = spheres.centerX.data();
+	const float* cy = spheres.centerY.data();
+	const float* cz = spheres.centerZ.data();
+	const float* r = spheres.radius.data();
+	size_t i = 0;
+
+	auto writeMask = [&](int mask, size_t first) {
+		while (mask != 0) {
+			out[numVisible++] = uint32_t(first + std::countr_zero((unsigned)mask));
+			mask &= mask - 1;
+		}
+	};
+
+#if defined(__AVX__)
+	{
+		__m256 pa[6], pb[6], pc[6], pd[6];
+		for (int p = 0; p < 6; p++) {
+			pa[p] = _mm256_set1_ps(frustum.planes[p].x);
+			pb[p] = _mm256_set1_ps(frustum.planes[p].y);
+			pc[p] = _mm256_set1_ps(frustum.planes[p].z);
+			pd[p] = _mm256_set1_ps(frustum.planes[p].w);
+		}
+		for (; i + 8 <= n; i += 8) {
+			__m256 x = _mm256_loadu_ps(cx + i);
+			__m256 y = _mm256_loadu_ps(cy + i);
+			__m256 z = _mm256_loadu_ps(cz + i);
+			__m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(r + i));
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++) {
+				__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pa[p], x), _mm256_mul_ps(pb[p], y)), _mm256_add_ps(_mm256_mul_ps(pc[p], z), pd[p]));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, negR, _CMP_GE_OQ));
+			}
+			writeMask(_mm256_movemask_ps(inside), i);
+		}
+	}
+#endif
+
+#if defined(INF2705_HAS_SSE2)
+	{
+		__m128 pa[6], pb[6], pc[6], pd[6];
+		for (int p = 0; p < 6; p++) {
+			pa[p] = _mm_set1_ps(frustum.planes[p].x);
+			pb[p] = _mm_set1_ps(frustum.planes[p].y);
+			pc[p] = _mm_set1_ps(frustum.planes[p].z);
+			pd[p] = _mm_set1_ps(frustum.planes[p].w);
+		}
+		for (; i + 4 <= n; i += 4) {
+			__m128 x = _mm_loadu_ps(cx + i);
+			__m128 y = _mm_loadu_ps(cy + i);
+			__m128 z = _mm_loadu_ps(cz + i);
+			__m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r + i));
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++) {
+				__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa[p], x), _mm_mul_ps(pb[p], y)), _mm_add_ps(_mm_mul_ps(pc[p], z), pd[p]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negR));
+			}
+			writeMask(_mm_movemask_ps(inside), i);
+		}
+	}
+#endif
+
+	for (; i < n; i++) {
+		if (frustum.intersects(BoundingSphere{{cx[i], cy[i], cz[i]}, r[i]}))
+			out[numVisible++] = uint32_t(i);
+	}
+
+	visibleIndices.resize(numVisible);
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+
+#include "GpuMemory.hpp"
+#include "Mesh.hpp"
+#include "utils.hpp"
+#include "VertexLayout.hpp"
+
+
+using namespace gl;
+
+
+// Allocateur de plages dans un espace de taille fixe (en nombre d'éléments). Les plages libres sont gardées triées par position; une plage libérée est fusionnée avec ses voisines libres pour limiter la fragmentation.
+class RangeAllocator
+{
+public:
+	static constexpr size_t invalidOffset = SIZE_MAX;
+
+	void reset(size_t capacity) {
+		freeRanges_.clear();
+		if (capacity != 0)
+			freeRanges_[0] = capacity;
+		capacity_ = capacity;
+	}
+
+	// Retourne la position de la plage allouée, ou invalidOffset s'il n'y a pas de plage libre assez grande. On prend la première plage qui convient, ce qui garde les allocations groupées au début.
+	size_t allocate(size_t size) {
+		if (size == 0)
+			return 0;
+		for (auto it = freeRanges_.begin(); it != freeRanges_.end(); ++it) {
+			auto [offset, freeSize] = *it;
+			if (freeSize < size)
+				continue;
+			freeRanges_.erase(it);
+			if (freeSize > size)
+				freeRanges_[offset + size] = freeSize - size;
+			return offset;
+		}
+		return invalidOffset;
+	}
+
+	void free(size_t offset, size_t size) {
+		if (size == 0 or offset == invalidOffset)
+			return;
+		auto next = freeRanges_.lower_bound(offset);
+		// Fusionner avec la plage libre précédente si elle se termine où commence celle-ci.
+		if (next != freeRanges_.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset) {
+				offset = prev->first;
+				size += prev->second;
+				freeRanges_.erase(prev);
+			}
+		}
+		// Fusionner avec la plage libre suivante.
+		if (next != freeRanges_.end() and offset + size == next->first) {
+			size += next->second;
+			freeRanges_.erase(next);
+		}
+		freeRanges_[offset] = size;
+	}
+
+	// Vrai si la plage est entièrement allouée : dans l'espace, sans chevaucher de plage libre.
+	bool isAllocated(size_t offset, size_t size) const {
+		if (offset == invalidOffset or offset > capacity_ or size > capacity_ - offset)
+			return false;
+		auto next = freeRanges_.upper_bound(offset);
+		if (next != freeRanges_.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second > offset)
+				return false;
+		}
+		return next == freeRanges_.end() or next->first >= offset + size;
+	}
+
+	size_t getCapacity() const { return capacity_; }
+
+	size_t getNumFreeElements() const {
+		size_t total = 0;
+		for (auto&& [offset, size] : freeRanges_)
+			total += size;
+		return total;
+	}
+
+	size_t getNumFreeRanges() const { return freeRanges_.size(); }
+
+private:
+	std::map<size_t, size_t> freeRanges_; // Position -> taille.
+	size_t capacity_ = 0;
+};
+
+// La place d'un mesh dans une GeometryArena.
+struct GeometryArenaAllocation
+{
+	size_t firstVertex = RangeAllocator::invalidOffset;
+	size_t numVertices = 0;
+	size_t firstIndex = RangeAllocator::invalidOffset;
+	size_t numIndices = 0;
+
+	bool isValid() const { return firstVertex != RangeAllocator::invalidOffset and firstIndex != RangeAllocator::invalidOffset; }
+};
+
+// La structure lue par glMultiDrawElementsIndirect pour chaque appel de dessin (définie par la spécification OpenGL).
+struct DrawElementsIndirectCommand
+{
+	GLuint count = 0;
+	GLuint instanceCount = 1;
+	GLuint firstIndex = 0;
+	GLint baseVertex = 0;
+	GLuint baseInstance = 0;
+};
+
+// Une arène de géométrie : les sommets et les indices de plusieurs mesh sont placés dans deux grands tampons partagés avec un seul VAO, au lieu d'un VAO/VBO/EBO par mesh. Les appels de dessin de chaque trame sont accumulés par « groupe d'état » (un entier choisi par l'application, par exemple un numéro de programme de nuanceur ou de texture), puis chaque groupe est tracé avec un seul glMultiDrawElementsIndirect.
+// Pour retrouver les données propres à chaque appel (matrice de modélisation, matériau, etc.), le VAO a un attribut entier par instance (drawIdLocation) qui vaut baseInstance + le numéro d'instance. On met dans baseInstance la position de l'appel dans les données de la trame, ce qui équivaut à gl_DrawID (qui demande OpenGL 4.6) sans dépendre de la version du nuanceur :
+//     layout(location = 10) in uint i_drawId;
+//     uniform samplerBuffer perDrawData; // Ou un tampon de uniformes, un SSBO, etc.
+// De la même façon, le VAO a un attribut par instance textureLayer (textureLayerLocation, comme dans InstanceData) qui vaut la couche donnée à addDraw, pour échantillonner une TextureArray par couche sans tampon de données par appel (voir layered_vert.glsl dans C08_Intro_GeoTess).
+// Sans OpenGL 4.3 (ou ARB_multi_draw_indirect), par exemple sur macOS, chaque groupe est tracé avec une boucle de glDrawElementsInstancedBaseVertex, en déplaçant les attributs drawId et textureLayer à chaque appel puisque baseInstance n'existe pas non plus.
+template <typename Vertex>
+class GeometryArena
+{
+public:
+	static constexpr GLuint drawIdLocation = 10;
+	static constexpr GLuint textureLayerLocation = 9; // Voir InstanceData et TextureArray.
+	static constexpr GLuint invalidDrawId = GLuint(-1);
+
+	GeometryArena() = default;
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	// Créer les tampons partagés. Leur taille est fixe : une arène pleine refuse les nouveaux mesh.
+	void create(size_t maxVertices, size_t maxIndices) {
+		deleteObjects();
+		vertexAllocator_.reset(maxVertices);
+		indexAllocator_.reset(maxIndices);
+		hasMultiDrawIndirect_ = isGLVersionOrExtensionSupported(4, 3, "GL_ARB_multi_draw_indirect");
+
+		glGenVertexArrays(1, &vao_);
+		glGenBuffers(1, &vbo_);
+		glGenBuffers(1, &ebo_);
+		glGenBuffers(1, &drawIdVbo_);
+		glGenBuffers(1, &layerVbo_);
+		glGenBuffers(1, &indirectBuffer_);
+
+		glBindVertexArray(vao_);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+		glBufferData(GL_ARRAY_BUFFER, maxVertices * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+		setupVertexAttribs<Vertex>();
+		// Le tampon des couches est rempli à chaque trame (voir uploadDrawLayers), mais l'attribut ne change pas.
+		glBindBuffer(GL_ARRAY_BUFFER, layerVbo_);
+		glVertexAttribPointer(textureLayerLocation, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+		glVertexAttribDivisor(textureLayerLocation, 1);
+		glEnableVertexAttribArray(textureLayerLocation);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, maxIndices * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		recordGpuAllocation(GpuMemoryCategory::Mesh, vbo_, maxVertices * sizeof(Vertex), "GeometryArena");
+		recordGpuAllocation(GpuMemoryCategory::Mesh, ebo_, maxIndices * sizeof(GLuint), "GeometryArena");
+	}
+
+	// Copier les sommets et les indices d'un mesh dans l'arène. Les indices restent relatifs au mesh, ils seront décalés par le baseVertex de l'appel de dessin. Le mesh doit avoir un tableau d'indices (par exemple chargé avec weldVertices), puisque tout est tracé avec des appels indexés.
+	GeometryArenaAllocation add(const Vertex* vertexData, size_t numVertices, const GLuint* indexData, size_t numIndices) {
+		GeometryArenaAllocation allocation;
+		allocation.firstVertex = vertexAllocator_.allocate(numVertices);
+		allocation.firstIndex = indexAllocator_.allocate(numIndices);
+		allocation.numVertices = numVertices;
+		allocation.numIndices = numIndices;
+		if (not allocation.isValid()) {
+			std::cerr << "ERROR geometry arena is full" << "\n";
+			// Rendre celle des deux plages qui a pu être allouée.
+			vertexAllocator_.free(allocation.firstVertex, numVertices);
+			indexAllocator_.free(allocation.firstIndex, numIndices);
+			return {};
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+		glBufferSubData(GL_ARRAY_BUFFER, allocation.firstVertex * sizeof(Vertex), numVertices * sizeof(Vertex), vertexData);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		// Le tampon d'indices est lié au VAO, il faut donc le lier avec le VAO actif pour ne pas changer celui d'un autre.
+		glBindVertexArray(vao_);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, allocation.firstIndex * sizeof(GLuint), numIndices * sizeof(GLuint), indexData);
+		glBindVertexArray(0);
+		return allocation;
+	}
+
+	GeometryArenaAllocation add(const BasicMesh<Vertex>& mesh) {
+		return add(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size());
+	}
+
+	// Vrai si la place est bien allouée dans cette arène (pas invalide, pas déjà libérée, pas d'une autre arène).
+	bool contains(const GeometryArenaAllocation& allocation) const {
+		return allocation.isValid() and vertexAllocator_.isAllocated(allocation.firstVertex, allocation.numVertices) and indexAllocator_.isAllocated(allocation.firstIndex, allocation.numIndices);
+	}
+
+	// Libérer la place d'un mesh. Ses données restent dans les tampons jusqu'à ce qu'un autre mesh prenne la place. Libérer deux fois la même place (par exemple par deux copies de l'allocation) est refusé, ce qui corromprait l'allocateur.
+	void remove(GeometryArenaAllocation& allocation) {
+		if (not contains(allocation)) {
+			if (allocation.isValid())
+				std::cerr << "ERROR geometry arena allocation is not allocated (already removed?)" << "\n";
+			allocation = {};
+			return;
+		}
+		vertexAllocator_.free(allocation.firstVertex, allocation.numVertices);
+		indexAllocator_.free(allocation.firstIndex, allocation.numIndices);
+		allocation = {};
+	}
+
+	// Ajouter un appel de dessin pour la trame courante. textureLayer est la valeur de l'attribut textureLayer pour toutes ses instances (la couche d'une TextureArray). Retourne la valeur de drawId de la première instance, donc la position des données de l'appel dans le tampon que l'application remplit pour le nuanceur, ou invalidDrawId si l'allocation n'est pas (ou plus) dans l'arène.
+	GLuint addDraw(const GeometryArenaAllocation& allocation, int stateBucket = 0, GLuint numInstances = 1, int textureLayer = 0) {
+		if (not contains(allocation)) {
+			std::cerr << "ERROR geometry arena draw uses an invalid or removed allocation" << "\n";
+			return invalidDrawId;
+		}
+		DrawElementsIndirectCommand command;
+		command.count = (GLuint)allocation.numIndices;
+		command.instanceCount = numInstances;
+		command.firstIndex = (GLuint)allocation.firstIndex;
+		command.baseVertex = (GLint)allocation.firstVertex;
+		command.baseInstance = numDrawIds_;
+		buckets_[stateBucket].push_back(command);
+		numDrawIds_ += numInstances;
+		drawLayers_.insert(drawLayers_.end(), numInstances, (float)textureLayer);
+		return command.baseInstance;
+	}
+
+	// Tracer tous les appels accumulés depuis le dernier clearDraws(), un groupe à la fois dans l'ordre de leur clé. setState(bucket) est appelé avant chaque groupe pour configurer l'état correspondant (programme, textures, etc.).
+	template <typename SetState>
+	void drawBuckets(SetState&& setState, GLenum drawMode = GL_TRIANGLES) {
+		if (buckets_.empty())
+			return;
+		uploadDrawIds();
+		uploadDrawLayers();
+
+		// Envoyer les commandes de tous les groupes d'un coup, chaque groupe est une plage du tampon indirect.
+		std::vector<DrawElementsIndirectCommand> commands;
+		for (auto&& [bucket, bucketCommands] : buckets_)
+			commands.insert(commands.end(), bucketCommands.begin(), bucketCommands.end());
+		if (hasMultiDrawIndirect_) {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer_);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+			recordGpuAllocation(GpuMemoryCategory::Buffer, indirectBuffer_, commands.size() * sizeof(DrawElementsIndirectCommand), "GeometryArena indirect");
+		}
+
+		glBindVertexArray(vao_);
+		size_t firstCommand = 0;
+		for (auto&& [bucket, bucketCommands] : buckets_) {
+			setState(bucket);
+			if (hasMultiDrawIndirect_) {
+				auto offset = (const void*)(firstCommand * sizeof(DrawElementsIndirectCommand));
+				glMultiDrawElementsIndirect(drawMode, GL_UNSIGNED_INT, offset, (GLsizei)bucketCommands.size(), 0);
+			} else {
+				for (auto&& command : bucketCommands) {
+					glBindBuffer(GL_ARRAY_BUFFER, drawIdVbo_);
+					glVertexAttribIPointer(drawIdLocation, 1, GL_UNSIGNED_INT, 0, (const void*)(command.baseInstance * sizeof(GLuint)));
+					glBindBuffer(GL_ARRAY_BUFFER, layerVbo_);
+					glVertexAttribPointer(textureLayerLocation, 1, GL_FLOAT, GL_FALSE, 0, (const void*)(command.baseInstance * sizeof(float)));
+					glDrawElementsInstancedBaseVertex(drawMode, command.count, GL_UNSIGNED_INT, (const void*)(command.firstIndex * sizeof(GLuint)), command.instanceCount, command.baseVertex);
+				}
+			}
+			firstCommand += bucketCommands.size();
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (hasMultiDrawIndirect_)
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	void draw(GLenum drawMode = GL_TRIANGLES) {
+		drawBuckets([](int) {}, drawMode);
+	}
+
+	// Vider les appels de dessin accumulés, typiquement au début de chaque trame.
+	void clearDraws() {
+		for (auto&& [bucket, bucketCommands] : buckets_)
+			bucketCommands.clear();
+		std::erase_if(buckets_, [](auto&& item) { return item.second.empty(); });
+		numDrawIds_ = 0;
+		drawLayers_.clear();
+	}
+
+	void deleteObjects() {
+		for (GLuint buffer : {vbo_, ebo_})
+			recordGpuFree(GpuMemoryCategory::Mesh, buffer);
+		for (GLuint buffer : {drawIdVbo_, layerVbo_, indirectBuffer_})
+			recordGpuFree(GpuMemoryCategory::Buffer, buffer);
+		glDeleteVertexArrays(1, &vao_);
+		glDeleteBuffers(1, &vbo_);
+		glDeleteBuffers(1, &ebo_);
+		glDeleteBuffers(1, &drawIdVbo_);
+		glDeleteBuffers(1, &layerVbo_);
+		glDeleteBuffers(1, &indirectBuffer_);
+		vao_ = vbo_ = ebo_ = drawIdVbo_ = layerVbo_ = indirectBuffer_ = 0;
+		drawIdCapacity_ = 0;
+		buckets_.clear();
+		numDrawIds_ = 0;
+		drawLayers_.clear();
+		vertexAllocator_.reset(0);
+		indexAllocator_.reset(0);
+	}
+
+	GLuint getVao() const { return vao_; }
+	const RangeAllocator& getVertexAllocator() const { return vertexAllocator_; }
+	const RangeAllocator& getIndexAllocator() const { return indexAllocator_; }
+
+private:
+	// Le tampon de l'attribut drawId contient simplement 0, 1, 2, ... : avec un diviseur de 1, chaque instance lit l'élément baseInstance + son numéro. On l'agrandit seulement quand la trame a plus d'instances que jamais auparavant.
+	void uploadDrawIds() {
+		if (numDrawIds_ <= drawIdCapacity_)
+			return;
+		drawIdCapacity_ = std::max<size_t>(numDrawIds_, drawIdCapacity_ * 2);
+		std::vector<GLuint> drawIds(drawIdCapacity_);
+		std::iota(drawIds.begin(), drawIds.end(), 0);
+
+		glBindVertexArray(vao_);
+		glBindBuffer(GL_ARRAY_BUFFER, drawIdVbo_);
+		glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(GLuint), drawIds.data(), GL_STATIC_DRAW);
+		recordGpuAllocation(GpuMemoryCategory::Buffer, drawIdVbo_, drawIds.size() * sizeof(GLuint), "GeometryArena drawId");
+		glVertexAttribIPointer(drawIdLocation, 1, GL_UNSIGNED_INT, 0, nullptr);
+		glVertexAttribDivisor(drawIdLocation, 1);
+		glEnableVertexAttribArray(drawIdLocation);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Contrairement aux drawId, les couches changent à chaque trame : le tampon est réalloué (GL_STREAM_DRAW) à chaque appel de drawBuckets.
+	void uploadDrawLayers() {
+		glBindBuffer(GL_ARRAY_BUFFER, layerVbo_);
+		glBufferData(GL_ARRAY_BUFFER, drawLayers_.size() * sizeof(float), drawLayers_.data(), GL_STREAM_DRAW);
+		recordGpuAllocation(GpuMemoryCategory::Buffer, layerVbo_, drawLayers_.size() * sizeof(float), "GeometryArena textureLayer");
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	GLuint vao_ = 0;
+	GLuint vbo_ = 0;
+	GLuint ebo_ = 0;
+	GLuint drawIdVbo_ = 0;
+	GLuint layerVbo_ = 0;
+	GLuint indirectBuffer_ = 0;
+	size_t drawIdCapacity_ = 0;
+	RangeAllocator vertexAllocator_;
+	RangeAllocator indexAllocator_;
+	// Les appels de la trame par groupe d'état, triés par clé.
+	std::map<int, std::vector<DrawElementsIndirectCommand>> buckets_;
+	GLuint numDrawIds_ = 0;
+	std::vector<float> drawLayers_; // La couche de chaque drawId de la trame.
+	bool hasMultiDrawIndirect_ = false;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+
+
+using namespace gl;
+
+
+// Les catégories de ressources suivies par GpuMemoryRegistry. Les objets OpenGL de catégories différentes peuvent avoir le même nom (un tampon et une texture peuvent tous deux être 1), la catégorie fait donc partie de la clé.
+enum class GpuMemoryCategory
+{
+	Mesh,         // Tampons de sommets et d'indices (Mesh, PackedMesh).
+	Texture,
+	UniformBlock,
+	Buffer,       // Autres tampons (instances, flux, arène de géométrie, etc.).
+	Count,
+};
+
+inline std::string_view getCategoryName(GpuMemoryCategory category) {
+	static constexpr std::array<std::string_view, (size_t)GpuMemoryCategory::Count> names = {"Mesh", "Texture", "UniformBlock", "Buffer"};
+	return names[(size_t)category];
+}
+
+// Registre central de la mémoire graphique allouée par les ressources de la bibliothèque. Chaque ressource déclare ses allocations (recordAllocation, qui remplace la taille précédente du même objet quand il est réalloué) et ses libérations (recordFree). On peut ainsi voir l'utilisation par catégorie et par objet, avec les sommets atteints, et trouver à la fermeture les ressources qu'on a oublié de libérer (reportLeaks, appelée par OpenGLApplication après onClose).
+// Les tailles sont celles demandées à OpenGL; le pilote peut allouer un peu plus (alignement, mipmaps complets, etc.).
+// Un budget optionnel (setBudget) appelle les fonctions d'éviction enregistrées quand le total le dépasse, par exemple pour libérer les niveaux de détail ou les textures les moins utilisés.
+class GpuMemoryRegistry
+{
+public:
+	struct Stats
+	{
+		size_t currentBytes = 0;
+		size_t highWaterBytes = 0;
+		size_t numObjects = 0;
+	};
+
+	// Une fonction d'éviction reçoit le nombre d'octets à libérer et retourne le nombre d'octets qu'elle a libérés (avec deleteObject(s), qui appellent recordFree).
+	using EvictionCallback = std::function<size_t(size_t bytesToFree)>;
+
+	// Le registre de l'application (partagé par toutes les ressources).
+	static GpuMemoryRegistry& getDefault() {
+		static GpuMemoryRegistry registry;
+		return registry;
+	}
+
+	void recordAllocation(GpuMemoryCategory category, GLuint object, size_t numBytes, std::string_view name = {}) {
+		if (object == 0)
+			return;
+		{
+			std::lock_guard lock(mutex_);
+			auto [it, inserted] = allocations_.try_emplace({category, object});
+			auto& allocation = it->second;
+			Stats& stats = categories_[(size_t)category];
+			if (inserted) {
+				stats.numObjects++;
+				total_.numObjects++;
+			}
+			stats.currentBytes += numBytes - allocation.numBytes;
+			total_.currentBytes += numBytes - allocation.numBytes;
+			stats.highWaterBytes = std::max(stats.highWaterBytes, stats.currentBytes);
+			total_.highWaterBytes = std::max(total_.highWaterBytes, total_.currentBytes);
+			allocation.numBytes = numBytes;
+			if (not name.empty())
+				allocation.name = name;
+		}
+		enforceBudget();
+	}
+
+	void recordFree(GpuMemoryCategory category, GLuint object) {
+		if (object == 0)
+			return;
+		std::lock_guard lock(mutex_);
+		auto it = allocations_.find({category, object});
+		if (it == allocations_.end())
+			return;
+		Stats& stats = categories_[(size_t)category];
+		stats.currentBytes -= it->second.numBytes;
+		stats.numObjects--;
+		total_.currentBytes -= it->second.numBytes;
+		total_.numObjects--;
+		allocations_.erase(it);
+	}
+
+	// Donner un nom lisible à un objet déjà enregistré (par exemple le fichier d'où vient une texture).
+	void setName(GpuMemoryCategory category, GLuint object, std::string_view name) {
+		std::lock_guard lock(mutex_);
+		auto it = allocations_.find({category, object});
+		if (it != allocations_.end())
+			it->second.name = name;
+	}
+
+	Stats getStats(GpuMemoryCategory category) const {
+		std::lock_guard lock(mutex_);
+		return categories_[(size_t)category];
+	}
+
+	Stats getTotalStats() const {
+		std::lock_guard lock(mutex_);
+		return total_;
+	}
+
+	// Un budget de 0 désactive l'éviction.
+	void setBudget(size_t numBytes) {
+		{
+			std::lock_guard lock(mutex_);
+			budget_ = numBytes;
+		}
+		enforceBudget();
+	}
+
+	size_t getBudget() const {
+		std::lock_guard lock(mutex_);
+		return budget_;
+	}
+
+	// Les fonctions d'éviction sont appelées dans l'ordre d'enregistrement jusqu'à ce que le total revienne sous le budget. Retourne un identifiant pour removeEvictionCallback.
+	int addEvictionCallback(EvictionCallback callback) {
+		std::lock_guard lock(mutex_);
+		int id = nextCallbackId_++;
+		evictionCallbacks_.push_back({id, std::move(callback)});
+		return id;
+	}
+
+	void removeEvictionCallback(int id) {
+		std::lock_guard lock(mutex_);
+		std::erase_if(evictionCallbacks_, [id](auto& entry) { return entry.first == id; });
+	}
+
+	// Afficher l'utilisation par catégorie.
+	void printReport(std::ostream& out = std::cout) const {
+		std::lock_guard lock(mutex_);
+		out << "GPU memory" << "\n";
+		for (size_t c = 0; c < (size_t)GpuMemoryCategory::Count; c++) {
+			auto& stats = categories_[c];
+			out << std::format("    {:<14}{:>6} objects {:>10.2f} MiB (peak {:.2f} MiB)", getCategoryName((GpuMemoryCategory)c), stats.numObjects, toMiB(stats.currentBytes), toMiB(stats.highWaterBytes)) << "\n";
+		}
+		out << std::format("    {:<14}{:>6} objects {:>10.2f} MiB (peak {:.2f} MiB)", "Total", total_.numObjects, toMiB(total_.currentBytes), toMiB(total_.highWaterBytes));
+		if (budget_ != 0)
+			out << std::format(", budget {:.2f} MiB", toMiB(budget_));
+		out << "\n";
+	}
+
+	// Afficher les objets encore alloués (normalement aucun après onClose). Retourne vrai s'il y en a.
+	bool reportLeaks(std::ostream& out = std::cerr) const {
+		std::lock_guard lock(mutex_);
+		if (allocations_.empty())
+			return false;
+		out << std::format("WARNING {} GPU objects ({:.2f} MiB) were not deleted:", allocations_.size(), toMiB(total_.currentBytes)) << "\n";
+		for (auto&& [key, allocation] : allocations_) {
+			out << std::format("    {} {} : {} bytes", getCategoryName(key.first), key.second, allocation.numBytes);
+			if (not allocation.name.empty())
+				out << " (" << allocation.name << ")";
+			out << "\n";
+		}
+		return true;
+	}
+
+private:
+	struct Allocation
+	{
+		size_t numBytes = 0;
+		std::string name;
+	};
+
+	static double toMiB(size_t numBytes) { return numBytes / (1024.0 * 1024.0); }
+
+	// Appeler les fonctions d'éviction hors du verrou, puisqu'elles libèrent des objets et appellent donc recordFree. Une allocation faite pendant l'éviction ne relance pas l'éviction.
+	void enforceBudget() {
+		std::vector<EvictionCallback> callbacks;
+		size_t excess = 0;
+		{
+			std::lock_guard lock(mutex_);
+			if (budget_ == 0 or total_.currentBytes <= budget_ or isEvicting_)
+				return;
+			isEvicting_ = true;
+			excess = total_.currentBytes - budget_;
+			for (auto&& [id, callback] : evictionCallbacks_)
+				callbacks.push_back(callback);
+		}
+		for (auto&& callback : callbacks) {
+			size_t freed = callback(excess);
+			excess -= std::min(excess, freed);
+			if (excess == 0)
+				break;
+		}
+		std::lock_guard lock(mutex_);
+		isEvicting_ = false;
+	}
+
+	mutable std::mutex mutex_;
+	std::map<std::pair<GpuMemoryCategory, GLuint>, Allocation> allocations_;
+	std::array<Stats, (size_t)GpuMemoryCategory::Count> categories_ = {};
+	Stats total_;
+	size_t budget_ = 0;
+	std::vector<std::pair<int, EvictionCallback>> evictionCallbacks_;
+	int nextCallbackId_ = 0;
+	bool isEvicting_ = false;
+};
+
+// Raccourcis pour le registre par défaut.
+inline void recordGpuAllocation(GpuMemoryCategory category, GLuint object, size_t numBytes, std::string_view name = {}) {
+	GpuMemoryRegistry::getDefault().recordAllocation(category, object, numBytes, name);
+}
+
+inline void recordGpuFree(GpuMemoryCategory category, GLuint object) {
+	GpuMemoryRegistry::getDefault().recordFree(category, object);
+}
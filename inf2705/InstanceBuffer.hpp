@@ -0,0 +1,102 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+
+#include "GpuMemory.hpp"
+#include "VertexLayout.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Données par instance pour BasicMesh::drawInstanced. Les localisations suivent celles des attributs de sommets (0 à 3). Dans le nuanceur de sommets :
+//     layout(location = 4) in mat4 i_model;        // Occupe les localisations 4 à 7 (une par colonne).
+//     layout(location = 8) in vec4 i_color;
+//     layout(location = 9) in float i_textureLayer;
+struct InstanceData
+{
+	mat4 model = mat4(1);
+	vec4 color = vec4(1);
+	float textureLayer = 0; // Couche d'une texture tableau (GL_TEXTURE_2D_ARRAY, voir TextureArray).
+};
+
+template <>
+struct VertexLayout<InstanceData>
+{
+	// Un attribut ne peut pas dépasser 4 composantes, la matrice est donc passée colonne par colonne.
+	static constexpr std::array attribs = {
+		makeVertexAttrib<vec4>(4, offsetof(InstanceData, model) + 0 * sizeof(vec4)),
+		makeVertexAttrib<vec4>(5, offsetof(InstanceData, model) + 1 * sizeof(vec4)),
+		makeVertexAttrib<vec4>(6, offsetof(InstanceData, model) + 2 * sizeof(vec4)),
+		makeVertexAttrib<vec4>(7, offsetof(InstanceData, model) + 3 * sizeof(vec4)),
+		makeVertexAttrib<vec4>(8, offsetof(InstanceData, color)),
+		makeVertexAttrib<float>(9, offsetof(InstanceData, textureLayer)),
+	};
+};
+
+// Un numéro unique pour chaque tampon d'instances créé, jamais réutilisé contrairement aux noms des tampons OpenGL.
+inline uint64_t makeInstanceBufferGeneration() {
+	static std::atomic<uint64_t> next = 1;
+	return next++;
+}
+
+// Un tampon de données par instance. On remplit le vecteur `instances` puis on envoie tout d'un coup avec update(), plutôt que de faire un setMat() et un appel de dessin par objet. Le type d'instance doit avoir une spécialisation de VertexLayout, comme un type de sommet.
+template <typename Instance = InstanceData>
+struct InstanceBuffer
+{
+	std::vector<Instance> instances;
+	GLuint vbo = 0;
+	uint64_t generation = 0; // Change à chaque création du tampon (voir BasicMesh::drawInstanced).
+	// Le nombre d'instances présentement dans le tampon en mémoire graphique et la taille du stockage alloué.
+	GLsizei numUploadedInstances = 0;
+	size_t capacity = 0;
+
+	// Envoyer toutes les instances. Quand le contenu entier change à chaque trame, on « orpheline » le stockage avec glBufferData(nullptr) avant d'écrire : le pilote peut donner un nouveau bloc de mémoire au lieu d'attendre que le GPU ait fini de lire l'ancien. Le stockage grandit en doublant pour éviter de le réallouer quand le nombre d'instances varie un peu.
+	void update(GLenum usageMode = GL_DYNAMIC_DRAW) {
+		if (vbo == 0) {
+			glGenBuffers(1, &vbo);
+			generation = makeInstanceBufferGeneration();
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		if (instances.size() > capacity)
+			capacity = std::max(instances.size(), capacity * 2);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Instance), nullptr, usageMode);
+		recordGpuAllocation(GpuMemoryCategory::Buffer, vbo, capacity * sizeof(Instance));
+		if (not instances.empty())
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(Instance), instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		numUploadedInstances = (GLsizei)instances.size();
+	}
+
+	// Envoyer seulement une plage d'instances, sans changer leur nombre (par exemple quelques objets qui ont bougé).
+	void updateRange(size_t first, size_t count) {
+		if (vbo == 0 or first >= (size_t)numUploadedInstances)
+			return;
+		count = std::min(count, (size_t)numUploadedInstances - first);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Instance), count * sizeof(Instance), instances.data() + first);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void deleteObject() {
+		recordGpuFree(GpuMemoryCategory::Buffer, vbo);
+		glDeleteBuffers(1, &vbo);
+		vbo = 0;
+		generation = 0;
+		numUploadedInstances = 0;
+		capacity = 0;
+	}
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+
+#ifdef _WIN32
+	#include <Windows.h>
+	#undef near
+	#undef far
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+
+// Un fichier projeté en mémoire en lecture seule (mmap sur POSIX, MapViewOfFile sur Windows). Le contenu est accessible directement par data() sans copie dans un tampon intermédiaire; le système d'exploitation charge les pages au besoin.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	MappedFile(const std::string& filename) {
+		open(filename);
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator= (const MappedFile&) = delete;
+
+	~MappedFile() {
+		close();
+	}
+
+	bool open(const std::string& filename) {
+		close();
+
+	#ifdef _WIN32
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize = {};
+		GetFileSizeEx(file, &fileSize);
+		size_ = (size_t)fileSize.QuadPart;
+		// On ne peut pas projeter un fichier vide, mais c'est quand même une ouverture réussie.
+		if (size_ != 0) {
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping != nullptr) {
+				data_ = (const std::byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				// La vue garde une référence sur la projection, on peut donc fermer les handles tout de suite.
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(file);
+	#else
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat fileStat = {};
+		fstat(fd, &fileStat);
+		size_ = (size_t)fileStat.st_size;
+		// On ne peut pas projeter un fichier vide, mais c'est quand même une ouverture réussie.
+		if (size_ != 0) {
+			void* ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED)
+				data_ = (const std::byte*)ptr;
+		}
+		// La projection reste valide après la fermeture du descripteur.
+		::close(fd);
+	#endif
+
+		if (size_ != 0 and data_ == nullptr) {
+			size_ = 0;
+			return false;
+		}
+		isOpen_ = true;
+		return true;
+	}
+
+	void close() {
+		if (data_ != nullptr) {
+		#ifdef _WIN32
+			UnmapViewOfFile(data_);
+		#else
+			munmap((void*)data_, size_);
+		#endif
+		}
+		data_ = nullptr;
+		size_ = 0;
+		isOpen_ = false;
+	}
+
+	bool isOpen() const { return isOpen_; }
+	const std::byte* data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	const std::byte* data_ = nullptr;
+	size_t size_ = 0;
+	bool isOpen_ = false;
+};
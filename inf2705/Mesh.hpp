@@ -3,9 +3,16 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <format>
 #include <fstream>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include <glbinding/gl/gl.h>
@@ -14,41 +21,21 @@
 #include <tiny_obj_loader.h>
 
 #include "utils.hpp"
+#include "Bounds.hpp"
+#include "GpuMemory.hpp"
+#include "InstanceBuffer.hpp"
+#include "MappedFile.hpp"
+#include "MeshNormals.hpp"
+#include "MeshOptimizer.hpp"
+#include "StreamingBuffer.hpp"
+#include "VertexLayout.hpp"
+#include "WavefrontParser.hpp"
 
 
 using namespace gl;
 using namespace glm;
 
 
-// Configurer l'attribut de sommets pour un membre scalaire `member` (int, float) d'une struct `elemType`.
-#define SET_SCALAR_VERTEX_ATTRIB_FROM_STRUCT_MEM(index, elemType, member)	\
-{																			\
-	glVertexAttribPointer(													\
-		(GLuint)index,														\
-		1,																	\
-		getTypeGLenum<decltype(elemType::member)>(),						\
-		GL_FALSE,															\
-		(GLint)sizeof(elemType),											\
-		(const void*)offsetof(elemType, member)								\
-	);																		\
-	glEnableVertexAttribArray(index);										\
-}																			\
-
-// Configurer l'attribut de sommets pour un membre vectoriel `member` (vec3, vec4) d'une struct `elemType`.
-#define SET_VEC_VERTEX_ATTRIB_FROM_STRUCT_MEM(index, elemType, member)	\
-{																		\
-	glVertexAttribPointer(												\
-		(GLuint)index,													\
-		(GLint)decltype(elemType::member)::length(),					\
-		getTypeGLenum<decltype(elemType::member)::value_type>(),		\
-		GL_FALSE,														\
-		(GLint)sizeof(elemType),										\
-		(const void*)offsetof(elemType, member)							\
-	);																	\
-	glEnableVertexAttribArray(index);									\
-}																		\
-
-
 // Informations de base d'un sommet
 struct VertexData
 {
@@ -58,16 +45,154 @@ struct VertexData
 	vec4 color;     // layout(location = 3)
 };
 
-// Un mesh (ou maillage) représente la géométrie d'un objet d'une façon traçable par OpenGL.
-struct Mesh
+template <>
+struct VertexLayout<VertexData>
+{
+	static constexpr std::array attribs = {
+		makeVertexAttrib<vec3>(0, offsetof(VertexData, position)),
+		makeVertexAttrib<vec3>(1, offsetof(VertexData, normal)),
+		makeVertexAttrib<vec2>(2, offsetof(VertexData, texCoords)),
+		makeVertexAttrib<vec4>(3, offsetof(VertexData, color)),
+	};
+};
+
+// Sommet complet avec en plus une tangente pour le placage de normales (voir computeVertexTangents). La localisation 11 suit celles des attributs d'instance (4 à 9) et de drawId (10).
+struct TangentVertexData
+{
+	vec3 position;  // layout(location = 0)
+	vec3 normal;    // layout(location = 1)
+	vec2 texCoords; // layout(location = 2)
+	vec4 color;     // layout(location = 3)
+	vec4 tangent;   // layout(location = 11), w = sens de la bitangente
+};
+
+template <>
+struct VertexLayout<TangentVertexData>
+{
+	static constexpr std::array attribs = {
+		makeVertexAttrib<vec3>(0, offsetof(TangentVertexData, position)),
+		makeVertexAttrib<vec3>(1, offsetof(TangentVertexData, normal)),
+		makeVertexAttrib<vec2>(2, offsetof(TangentVertexData, texCoords)),
+		makeVertexAttrib<vec4>(3, offsetof(TangentVertexData, color)),
+		makeVertexAttrib<vec4>(11, offsetof(TangentVertexData, tangent)),
+	};
+};
+
+// Sommet avec seulement une position (12 octets au lieu de 48), pour les lignes et autres formes simples. Les autres attributs prennent leur valeur par défaut dans le nuanceur.
+struct PositionVertexData
+{
+	vec3 position; // layout(location = 0)
+};
+
+template <>
+struct VertexLayout<PositionVertexData>
+{
+	static constexpr std::array attribs = {
+		makeVertexAttrib<vec3>(0, offsetof(PositionVertexData, position)),
+	};
+};
+
+// Fonctions de hachage et d'égalité pour utiliser un triplet d'indices de tinyobj (position, normale, coords de texture) comme clé de dictionnaire.
+struct WavefrontIndexHash
+{
+	size_t operator()(const tinyobj::index_t& idx) const {
+		size_t h = std::hash<int>()(idx.vertex_index);
+		h = h * 31 + std::hash<int>()(idx.normal_index);
+		h = h * 31 + std::hash<int>()(idx.texcoord_index);
+		return h;
+	}
+};
+
+struct WavefrontIndexEqual
+{
+	bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const {
+		return a.vertex_index == b.vertex_index and a.normal_index == b.normal_index and a.texcoord_index == b.texcoord_index;
+	}
+};
+
+// En-tête du cache binaire de mesh (voir Mesh::loadFromWavefrontFileCached). Il est suivi d'une MeshCacheEntry par objet, puis des tableaux de sommets et d'indices de chaque objet, alignés sur 16 octets et disposés exactement comme ils sont passés à glBufferData.
+struct MeshCacheHeader
+{
+	char magic[8] = {'I', 'N', 'F', '2', '7', '0', '5', 'M'};
+	uint32_t version = 5;
+	uint32_t numMeshes = 0;
+	// Clé du fichier source et des options de chargement : le cache est invalide si un de ces champs ne correspond plus.
+	uint64_t sourceSize = 0;
+	int64_t sourceWriteTime = 0;
+	uint64_t sourceHash = 0;
+	uint64_t vertexLayoutHash = 0; // Voir hashVertexLayout.
+	uint32_t weldedVertices = 0;
+	uint32_t generatedNormals = 0;
+};
+
+// Position (en octets depuis le début du fichier) et taille des données d'un objet dans le cache binaire.
+struct MeshCacheEntry
+{
+	uint64_t vertexOffset = 0;
+	uint64_t numVertices = 0;
+	uint64_t indexOffset = 0;
+	uint64_t numIndices = 0;
+	// Erreur géométrique d'un niveau de détail simplifié (voir LodChain), 0 pour un mesh chargé tel quel.
+	float simplificationError = 0;
+	uint32_t padding = 0;
+};
+
+// Une plage d'éléments [begin, end) modifiés depuis le dernier envoi en mémoire graphique. Plusieurs modifications sont fusionnées en une seule plage qui les couvre toutes.
+struct DirtyRange
+{
+	size_t begin = SIZE_MAX;
+	size_t end = 0;
+
+	bool isEmpty() const { return begin >= end; }
+
+	void add(size_t first, size_t count) {
+		begin = std::min(begin, first);
+		end = std::max(end, first + count);
+	}
+
+	void clear() { *this = {}; }
+};
+
+// Un mesh (ou maillage) représente la géométrie d'un objet d'une façon traçable par OpenGL. Le type de sommet est un paramètre de template : il doit avoir un membre `position` (vec3) et une spécialisation de VertexLayout qui décrit ses attributs. Les autres membres connus (normal, texCoords) sont remplis au chargement s'ils existent.
+// On utilise la plupart du temps l'alias Mesh, qui prend les sommets complets de VertexData.
+template <typename Vertex>
+struct BasicMesh
 {
-	std::vector<VertexData> vertices;
+	using VertexType = Vertex;
+
+	std::vector<Vertex> vertices;
 	std::vector<GLuint> indices;
 	GLuint vao = 0;
 	GLuint vbo = 0;
 	GLuint ebo = 0;
+	// Le nombre d'éléments présentement dans les tampons en mémoire graphique (mis à jour par updateBuffers).
+	GLsizei numUploadedVertices = 0;
+	GLsizei numUploadedIndices = 0;
+	// La taille (en nombre d'éléments) du stockage alloué pour chaque tampon, qui peut être plus grande que ce qui est utilisé.
+	size_t vertexCapacity = 0;
+	size_t indexCapacity = 0;
+	// Les éléments modifiés depuis le dernier update().
+	DirtyRange dirtyVertices;
+	DirtyRange dirtyIndices;
+	// Position du premier sommet (en sommets) et du premier indice (en octets) dans les tampons. Ils sont nuls sauf pour un mesh tracé à partir d'un StreamingBuffer (voir stream()).
+	GLint baseVertex = 0;
+	size_t indexByteOffset = 0;
+	// Le StreamingBuffer vers lequel pointe le VAO, s'il y a lieu.
+	GLuint streamingBuffer = 0;
+	// La génération (InstanceBuffer::generation) du tampon d'instances dont les attributs sont configurés dans le VAO (voir drawInstanced()). Le nom du tampon ne suffit pas : OpenGL peut redonner le nom d'un tampon supprimé à un nouveau tampon.
+	uint64_t instanceBufferGeneration = 0;
+	// Les attributs d'instance dont les tableaux sont présentement activés dans le VAO (un bit par localisation). draw() les désactive pour que les attributs reprennent leur valeur constante (par exemple TextureArray::setCurrentLayer), drawInstanced() les réactive.
+	uint32_t enabledInstanceAttribs = 0;
+	// Volumes englobants dans l'espace de l'objet, calculés au chargement et par setup().
+	BoundingBox boundingBox;
+	BoundingSphere boundingSphere;
 
 	void setup(GLenum usageMode = GL_STATIC_DRAW) {
+		setupFromData(vertices.data(), vertices.size(), indices.data(), indices.size(), usageMode);
+	}
+
+	// Comme setup(), mais à partir de données qui ne sont pas dans les vecteurs du mesh (par exemple un fichier projeté en mémoire).
+	void setupFromData(const Vertex* vertexData, size_t numVertices, const GLuint* indexData, size_t numIndices, GLenum usageMode = GL_STATIC_DRAW) {
 		// Créer les buffer objects.
 		if (vao == 0)
 			glGenVertexArrays(1, &vao);
@@ -76,18 +201,79 @@ struct Mesh
 		if (ebo == 0)
 			glGenBuffers(1, &ebo);
 
+		if (numVertices != 0)
+			computeBoundsFromData(vertexData, numVertices);
+
 		// Mettre les données dans les tampons en mémoire graphique.
-		updateBuffers(usageMode);
-		// Configurer les attributs selon la struct VertexData.
+		updateBuffers(vertexData, numVertices, indexData, numIndices, usageMode);
+		// Configurer les attributs selon le type de sommet.
 		setupAttribs();
 	}
 
+	// Comme setup(), mais seulement les tampons, sans le VAO. Les tampons sont partagés entre contextes et peuvent donc être remplis dans le contexte d'un autre fil (voir UploadThread); le VAO, lui, doit être créé par setupVao() dans le contexte qui trace.
+	void uploadBuffers(GLenum usageMode = GL_STATIC_DRAW) {
+		if (vbo == 0)
+			glGenBuffers(1, &vbo);
+		if (ebo == 0)
+			glGenBuffers(1, &ebo);
+		computeBounds();
+
+		bindVbo();
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), usageMode);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (not indices.empty()) {
+			bindEbo();
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), usageMode);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		}
+		numUploadedVertices = (GLsizei)vertices.size();
+		numUploadedIndices = (GLsizei)indices.size();
+		vertexCapacity = vertices.size();
+		indexCapacity = indices.size();
+		dirtyVertices.clear();
+		dirtyIndices.clear();
+		recordGpuMemory();
+	}
+
+	// Créer le VAO pour des tampons déjà remplis (voir uploadBuffers). Le tampon d'indices fait partie de l'état du VAO, il faut donc le lier pendant que le VAO est actif.
+	void setupVao() {
+		if (vao == 0)
+			glGenVertexArrays(1, &vao);
+		bindVao();
+		bindEbo();
+		unbindVao();
+		setupAttribs();
+	}
+
+	void computeBounds() {
+		computeBoundsFromData(vertices.data(), vertices.size());
+	}
+
+	// Seulement pour les sommets dont la position est un vec3. Les positions quantifiées d'un mesh compressé ne peuvent pas être décodées ici : ses volumes englobants sont calculés par makePackedMesh et gardés tels quels.
+	void computeBoundsFromData(const Vertex* vertexData, size_t numVertices) {
+		if constexpr (std::is_same_v<decltype(Vertex::position), vec3>)
+			::computeBounds(numVertices, [vertexData](size_t i) { return vertexData[i].position; }, boundingBox, boundingSphere);
+	}
+
+	// L'angle des arêtes vives quand on calcule les normales d'un fichier qui n'en a pas (voir generateNormals dans loadFromWavefrontFile).
+	static constexpr float defaultCreaseAngle = 60;
+
+	// Calculer des normales lisses (voir computeVertexNormals). Des sommets peuvent être ajoutés aux arêtes vives si creaseAngleDegrees est plus petit que 180. Avec pool nul, tout est fait dans le fil courant.
+	void computeNormals(float creaseAngleDegrees = 180, ThreadPool* pool = &ThreadPool::getDefault()) {
+		computeVertexNormals(vertices, indices, creaseAngleDegrees, pool);
+	}
+
+	// Calculer les tangentes à partir des normales et des coordonnées de texture (voir computeVertexTangents). Le type de sommet doit avoir un membre tangent (vec4), par exemple TangentVertexData.
+	void computeTangents(ThreadPool* pool = &ThreadPool::getDefault()) {
+		computeVertexTangents(vertices, indices, pool);
+	}
+
 	void draw(GLenum drawMode = GL_TRIANGLES) {
 		bindVao();
 
 		// Avoir un tableau d'indices vide ou non indique si on veut dessiner avec les données directement ou avec un tableau de connectivité.
-		if (not indices.empty())
-			drawElements(drawMode, (GLsizei)indices.size());
+		if (numUploadedIndices != 0)
+			drawElements(drawMode, numUploadedIndices);
 		else
 			drawArrays(drawMode);
 
@@ -95,54 +281,223 @@ struct Mesh
 	}
 
 	void drawArrays(GLenum drawMode, GLint offset = 0) {
+		disableInstanceAttribs();
 		// Techniquement, on n'a pas besoin de refaire les glBindBuffer, mais ça ne coûte pas cher et c'est plus fiable de les refaire.
-		bindVbo();
+		if (vbo != 0)
+			bindVbo();
 		// Tracer selon le tampon de données.
-		glDrawArrays(drawMode, offset, (GLsizei)vertices.size());
+		glDrawArrays(drawMode, baseVertex + offset, numUploadedVertices);
 	}
 
 	void drawElements(GLenum drawMode, GLsizei numIndices, GLsizei offset = 0) {
+		disableInstanceAttribs();
 		// Techniquement, on n'a pas besoin de refaire les glBindBuffer, mais ça ne coûte pas cher et c'est plus fiable de les refaire.
-		bindEbo();
-		// Tracer selon le tampon d'indices.
-		glDrawElements(drawMode, numIndices, GL_UNSIGNED_INT, (const void*)(size_t)offset);
+		// Un mesh dans un StreamingBuffer n'a pas de tampon d'indices propre, celui du VAO est déjà le bon.
+		if (ebo != 0)
+			bindEbo();
+		// Tracer selon le tampon d'indices. Le baseVertex est ajouté à chaque indice.
+		glDrawElementsBaseVertex(drawMode, numIndices, GL_UNSIGNED_INT, (const void*)(indexByteOffset + offset), baseVertex);
+	}
+
+	// Tracer une copie du mesh par instance du tampon en un seul appel de dessin. Les attributs d'instance sont ajoutés au VAO du mesh la première fois (ou quand on change de tampon d'instances, ou que le tampon a été recréé). Ils ne restent activés que pour les appels instanciés : draw() les désactive, et ils sont réactivés ici au besoin.
+	template <typename Instance>
+	void drawInstanced(const InstanceBuffer<Instance>& instances, GLenum drawMode = GL_TRIANGLES) {
+		if (instances.numUploadedInstances == 0)
+			return;
+
+		bindVao();
+		if (instanceBufferGeneration != instances.generation) {
+			glBindBuffer(GL_ARRAY_BUFFER, instances.vbo);
+			setupInstanceAttribs<Instance>();
+			instanceBufferGeneration = instances.generation;
+		} else if (enabledInstanceAttribs == 0) {
+			setVertexAttribArraysEnabled(getVertexAttribMask<Instance>(), true);
+		}
+		enabledInstanceAttribs = getVertexAttribMask<Instance>();
+
+		if (numUploadedIndices != 0) {
+			if (ebo != 0)
+				bindEbo();
+			glDrawElementsInstancedBaseVertex(drawMode, numUploadedIndices, GL_UNSIGNED_INT, (const void*)indexByteOffset, instances.numUploadedInstances, baseVertex);
+		} else {
+			glDrawArraysInstanced(drawMode, baseVertex, numUploadedVertices, instances.numUploadedInstances);
+		}
+
+		unbindVao();
 	}
 
 	void updateBuffers(GLenum usageMode = GL_STATIC_DRAW) {
+		updateBuffers(vertices.data(), vertices.size(), indices.data(), indices.size(), usageMode);
+	}
+
+	void updateBuffers(const Vertex* vertexData, size_t numVertices, const GLuint* indexData, size_t numIndices, GLenum usageMode = GL_STATIC_DRAW) {
 		bindVao();
 		bindVbo();
 		bindEbo();
 
-		if (not vertices.empty()) {
-			auto numBytes = vertices.size() * sizeof(VertexData);
-			glBufferData(GL_ARRAY_BUFFER, numBytes, vertices.data(), usageMode);
+		if (numVertices != 0) {
+			auto numBytes = numVertices * sizeof(Vertex);
+			glBufferData(GL_ARRAY_BUFFER, numBytes, vertexData, usageMode);
 		}
-		if (not indices.empty()) {
-			auto numBytes = indices.size() * sizeof(GLuint);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, numBytes, indices.data(), usageMode);
+		if (numIndices != 0) {
+			auto numBytes = numIndices * sizeof(GLuint);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, numBytes, indexData, usageMode);
 		}
+		numUploadedVertices = (GLsizei)numVertices;
+		numUploadedIndices = (GLsizei)numIndices;
+		// glBufferData alloue exactement ce qui est passé. Sans données, l'ancien stockage est gardé tel quel.
+		if (numVertices != 0)
+			vertexCapacity = numVertices;
+		if (numIndices != 0)
+			indexCapacity = numIndices;
+		dirtyVertices.clear();
+		dirtyIndices.clear();
+		recordGpuMemory();
 
 		unbindVao();
 	}
 
+	// Indiquer qu'une plage de sommets ou d'indices a été modifiée et doit être envoyée au prochain update().
+	void markVerticesDirty(size_t first, size_t count) { dirtyVertices.add(first, count); }
+	void markIndicesDirty(size_t first, size_t count) { dirtyIndices.add(first, count); }
+	void markAllDirty() {
+		markVerticesDirty(0, vertices.size());
+		markIndicesDirty(0, indices.size());
+	}
+
+	// Mise à jour pour les mesh dynamiques (modifiés à chaque trame par exemple). Contrairement à setup(), on n'envoie que les plages marquées comme modifiées avec glBufferSubData. Le stockage est réalloué seulement si les données ne rentrent plus, en doublant sa taille pour que des agrandissements successifs restent rares. Les attributs sont configurés seulement à la création du VAO, puisqu'ils référencent le VBO et non son stockage.
+	void update(GLenum usageMode = GL_DYNAMIC_DRAW) {
+		bool isNewVao = vao == 0;
+		if (vao == 0)
+			glGenVertexArrays(1, &vao);
+		if (vbo == 0)
+			glGenBuffers(1, &vbo);
+		if (ebo == 0)
+			glGenBuffers(1, &ebo);
+
+		bindVao();
+		bindVbo();
+		bindEbo();
+		uploadDirtyRange(GL_ARRAY_BUFFER, vertices.data(), sizeof(Vertex), vertices.size(), vertexCapacity, dirtyVertices, usageMode);
+		uploadDirtyRange(GL_ELEMENT_ARRAY_BUFFER, indices.data(), sizeof(GLuint), indices.size(), indexCapacity, dirtyIndices, usageMode);
+		numUploadedVertices = (GLsizei)vertices.size();
+		numUploadedIndices = (GLsizei)indices.size();
+		unbindVao();
+		recordGpuMemory();
+
+		if (isNewVao)
+			setupAttribs();
+	}
+
+	// Écrire les sommets et les indices dans la région courante d'un StreamingBuffer plutôt que dans des tampons propres au mesh. Le VAO pointe alors vers le tampon partagé et draw() trace à partir de la position des sous-allocations, sans glBufferData ni synchronisation implicite. Il faut le refaire à chaque trame (entre beginFrame() et endFrame()) où le mesh est tracé. Un mesh tracé ainsi ne doit pas aussi utiliser setup() ou update().
+	bool stream(StreamingBuffer& buffer) {
+		// Les sommets sont alignés sur leur taille pour que leur position soit un nombre entier de sommets, qui devient le baseVertex des appels de dessin.
+		auto vertexAllocation = buffer.write(vertices.data(), vertices.size() * sizeof(Vertex), sizeof(Vertex));
+		StreamingAllocation indexAllocation;
+		if (not indices.empty())
+			indexAllocation = buffer.write(indices.data(), indices.size() * sizeof(GLuint), sizeof(GLuint));
+		if (not vertexAllocation.isValid() or (not indices.empty() and not indexAllocation.isValid()))
+			return false;
+
+		// Les attributs ne dépendent pas de la position des données, on les configure donc seulement quand le VAO change de tampon.
+		if (vao == 0 or streamingBuffer != buffer.getBuffer()) {
+			if (vao == 0)
+				glGenVertexArrays(1, &vao);
+			bindVao();
+			glBindBuffer(GL_ARRAY_BUFFER, buffer.getBuffer());
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.getBuffer());
+			setupVertexAttribs<Vertex>();
+			unbindVao();
+			streamingBuffer = buffer.getBuffer();
+		}
+
+		baseVertex = GLint(vertexAllocation.offset / sizeof(Vertex));
+		indexByteOffset = indexAllocation.offset;
+		numUploadedVertices = (GLsizei)vertices.size();
+		numUploadedIndices = (GLsizei)indices.size();
+		return true;
+	}
+
 	void setupAttribs() {
 		bindVao();
 		bindVbo();
 
-		// Les données des sommets (positions, normales, coords de textures, couleurs) sont placées ensembles dans le même tampon, de façon contigües. Les attributs sont configurés pour accéder à un membre de VertexData dans chaque élément.
-		SET_VEC_VERTEX_ATTRIB_FROM_STRUCT_MEM(0, VertexData, position);
-		SET_VEC_VERTEX_ATTRIB_FROM_STRUCT_MEM(1, VertexData, normal);
-		SET_VEC_VERTEX_ATTRIB_FROM_STRUCT_MEM(2, VertexData, texCoords);
-		SET_VEC_VERTEX_ATTRIB_FROM_STRUCT_MEM(3, VertexData, color);
+		// Les données des sommets (positions, normales, coords de textures, couleurs) sont placées ensembles dans le même tampon, de façon contigües. Les attributs sont configurés pour accéder à un membre du type de sommet dans chaque élément, selon la liste de VertexLayout<Vertex>.
+		setupVertexAttribs<Vertex>();
 
 		unbindVao();
 	}
 
+	// Réordonner les triangles et les sommets pour le cache de sommets post-transformation, le surdessin et la lecture du tampon de sommets (voir MeshOptimizer.hpp). Le mesh doit être une liste de triangles avec un tableau d'indices (par exemple chargé avec weldVertices). Retourne l'ACMR et l'ATVR avant et après.
+	// On modifie seulement les vecteurs, il faut donc refaire setup() si le mesh était déjà dans les tampons.
+	MeshOptimizationStats optimize(int cacheSize = 16) {
+		MeshOptimizationStats stats;
+		if (indices.size() < 3)
+			return stats;
+		stats.before = computeVertexCacheStats(indices, vertices.size(), cacheSize);
+
+		// D'abord l'ordre des triangles pour le cache, puis l'ordre des groupes de triangles pour le surdessin.
+		std::vector<size_t> clusterStarts;
+		indices = optimizeVertexCacheTipsify(indices, vertices.size(), cacheSize, &clusterStarts);
+		indices = optimizeOverdraw(indices, clusterStarts, [this](GLuint v) { return vertices[v].position; });
+
+		// Ensuite l'ordre des sommets selon le nouvel ordre des triangles.
+		auto remap = computeVertexFetchRemap(indices, vertices.size());
+		std::vector<Vertex> remappedVertices(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++)
+			remappedVertices[remap[v]] = vertices[v];
+		vertices = std::move(remappedVertices);
+		for (auto&& index : indices)
+			index = remap[index];
+
+		stats.after = computeVertexCacheStats(indices, vertices.size(), cacheSize);
+		return stats;
+	}
+
 	void deleteObjects() {
+		recordGpuFree(GpuMemoryCategory::Mesh, vbo);
+		recordGpuFree(GpuMemoryCategory::Mesh, ebo);
 		glDeleteVertexArrays(1, &vao);
 		glDeleteBuffers(1, &vbo);
 		glDeleteBuffers(1, &ebo);
 		vao = vbo = ebo = 0;
+		numUploadedVertices = numUploadedIndices = 0;
+		vertexCapacity = indexCapacity = 0;
+		baseVertex = 0;
+		indexByteOffset = 0;
+		streamingBuffer = 0;
+		instanceBufferGeneration = 0;
+		enabledInstanceAttribs = 0;
+	}
+
+	// Désactiver les attributs d'instance laissés dans le VAO (lié) par drawInstanced(), avant un appel de dessin sans instances.
+	void disableInstanceAttribs() {
+		if (enabledInstanceAttribs == 0)
+			return;
+		setVertexAttribArraysEnabled(enabledInstanceAttribs, false);
+		enabledInstanceAttribs = 0;
+	}
+
+	// Déclarer la taille des tampons au registre de mémoire graphique.
+	void recordGpuMemory() const {
+		recordGpuAllocation(GpuMemoryCategory::Mesh, vbo, vertexCapacity * sizeof(Vertex));
+		recordGpuAllocation(GpuMemoryCategory::Mesh, ebo, indexCapacity * sizeof(GLuint));
+	}
+
+	// Envoyer la plage modifiée d'un tableau au tampon lié à `target`, en agrandissant le stockage au besoin.
+	static void uploadDirtyRange(GLenum target, const void* data, size_t elemSize, size_t numElems, size_t& capacity, DirtyRange& dirty, GLenum usageMode) {
+		if (numElems > capacity) {
+			// Le nouveau stockage est vide, il faut donc tout renvoyer.
+			capacity = std::max(numElems, capacity * 2);
+			glBufferData(target, capacity * elemSize, nullptr, usageMode);
+			dirty.add(0, numElems);
+		}
+		dirty.end = std::min(dirty.end, numElems);
+		if (not dirty.isEmpty()) {
+			auto bytes = (const std::byte*)data;
+			glBufferSubData(target, dirty.begin * elemSize, (dirty.end - dirty.begin) * elemSize, bytes + dirty.begin * elemSize);
+		}
+		dirty.clear();
 	}
 
 	void bindVao() { glBindVertexArray(vao); }
@@ -150,8 +505,9 @@ struct Mesh
 	void bindVbo() { glBindBuffer(GL_ARRAY_BUFFER, vbo); }
 	void bindEbo() { glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo); }
 
-	// Charge des mesh d'objets à partir d'un fichier Wavefront (il peut y avoir plusieurs objets dans le même fichier). Les données sont chargées par sommet sans tableau d'indices.
-	static std::vector<Mesh> loadFromWavefrontFile(std::string_view filename, bool setupOnLoad = true) {
+	// Charge des mesh d'objets à partir d'un fichier Wavefront (il peut y avoir plusieurs objets dans le même fichier). Par défaut, les données sont chargées par sommet sans tableau d'indices. Si weldVertices est vrai, les coins de faces qui partagent les mêmes attributs sont fusionnés en un seul sommet et un tableau d'indices est construit.
+	// Si generateNormals est vrai et que le fichier n'a pas de normales, elles sont calculées en gardant les arêtes vives (defaultCreaseAngle). Ce calcul et celui des tangentes se font dans le fil courant, le chargement pouvant lui-même être une tâche du bassin; pour un gros mesh chargé dans le fil principal, il vaut mieux charger sans setup et appeler computeNormals, qui se répartit sur le bassin.
+	static std::vector<BasicMesh> loadFromWavefrontFile(std::string_view filename, bool setupOnLoad = true, bool weldVertices = false, bool generateNormals = false) {
 		// Code inspiré de l'exemple https://github.com/tinyobjloader/tinyobjloader/tree/release#example-code-new-object-oriented-api
 
 		// Lire le fichier et vérifier les erreurs. On le charge en spécifiant à tinyobjloader de faire la séparation en triangles des faces non triangulaires (des quadrilatères par exemple).
@@ -165,43 +521,245 @@ struct Mesh
 		if (not reader.Warning().empty())
 			std::cerr << "WARNING tinyobj::ObjReader: " << reader.Warning();
 
-		std::vector<Mesh> result;
+		auto& attribs = reader.GetAttrib();
+		std::vector<BasicMesh> result;
 
 		// Pour chaque objet défini dans le fichier:
 		for (auto&& shape : reader.GetShapes()) {
-			Mesh mesh;
-
-			size_t index_offset = 0;
-			// Pour chaque face:
-			for (auto&& numVertices : shape.mesh.num_face_vertices) {
-				// Pour chaque sommet de la face:
-				for (size_t v = 0; v < numVertices; v++) {
-					VertexData data = {};
-					// Obtenir les indices des éléments du sommet.
-					tinyobj::index_t idx = shape.mesh.indices[index_offset + v];
-					auto& attribs = reader.GetAttrib();
-
-					// Copier la position.
-					data.position = *(const vec3*)&attribs.vertices[3 * size_t(idx.vertex_index)];
-					// Copier la normale si l'index de normales est positif.
-					if (idx.normal_index >= 0)
-						data.normal = normalize(*(const vec3*)&attribs.normals[3 * size_t(idx.normal_index)]);
-					// Copier les coordonnées de texture si l'index est positif.
-					if (idx.texcoord_index >= 0)
-						data.texCoords = *(const vec2*)&attribs.texcoords[2 * size_t(idx.texcoord_index)];
-
-					// Ajouter le sommet au tableau de sommets.
-					mesh.vertices.push_back(data);
-				}
-				index_offset += numVertices;
-			}
+			// Les faces ont été séparées en triangles, les indices de l'objet sont donc simplement trois coins par triangle à la suite.
+			BasicMesh mesh = makeFromWavefrontIndices(attribs, shape.mesh.indices.data(), shape.mesh.indices.size(), weldVertices, generateNormals);
+			if (setupOnLoad)
+				mesh.setup();
+			result.push_back(std::move(mesh));
+		}
 
+		return result;
+	}
+
+	// Comme loadFromWavefrontFile, mais avec l'analyseur maison de WavefrontParser.hpp plutôt que tinyobj. Le fichier est lu par blocs et analysé en parallèle sur le bassin de fils par défaut, ce qui est beaucoup plus rapide pour les gros fichiers et évite d'avoir tout le texte en mémoire.
+	static std::vector<BasicMesh> loadFromWavefrontFileParallel(std::string_view filename, bool setupOnLoad = true, bool weldVertices = false, bool generateNormals = false) {
+		WavefrontData data = WavefrontData::parseFile(std::string(filename));
+
+		std::vector<BasicMesh> result;
+		for (auto&& shape : data.shapes) {
+			BasicMesh mesh = makeFromWavefrontIndices(data.attribs, data.indices.data() + shape.firstIndex, shape.numIndices, weldVertices, generateNormals);
 			if (setupOnLoad)
 				mesh.setup();
 			result.push_back(std::move(mesh));
 		}
+		return result;
+	}
 
+	// Construire un mesh à partir des tableaux d'attributs de tinyobj et d'une suite de triplets d'indices (un par coin de triangle).
+	static BasicMesh makeFromWavefrontIndices(const tinyobj::attrib_t& attribs, const tinyobj::index_t* cornerIndices, size_t numCorners, bool weldVertices, bool generateNormals) {
+		BasicMesh mesh;
+		// En mode soudé, on se rappelle de l'indice du sommet créé pour chaque triplet d'indices de tinyobj. Un coin de face déjà rencontré réutilise alors le même sommet, ce qui réduit la taille du VBO et permet au cache de sommets post-transformation du GPU d'éviter de réexécuter le nuanceur de sommets.
+		std::unordered_map<tinyobj::index_t, GLuint, WavefrontIndexHash, WavefrontIndexEqual> uniqueVertices;
+		if (weldVertices) {
+			mesh.indices.reserve(numCorners);
+			uniqueVertices.reserve(numCorners / 2);
+		} else {
+			mesh.vertices.reserve(numCorners);
+		}
+
+		// Pour chaque coin de triangle:
+		for (size_t i = 0; i < numCorners; i++) {
+			// Obtenir les indices des éléments du sommet.
+			const tinyobj::index_t& idx = cornerIndices[i];
+
+			if (weldVertices) {
+				// Ajouter l'indice au tableau de connectivité et passer au suivant si le sommet existe déjà.
+				auto [it, inserted] = uniqueVertices.try_emplace(idx, (GLuint)mesh.vertices.size());
+				mesh.indices.push_back(it->second);
+				if (not inserted)
+					continue;
+			}
+
+			// Ajouter le sommet au tableau de sommets.
+			mesh.vertices.push_back(makeWavefrontVertex(attribs, idx));
+		}
+		// Le fichier n'a pas de normales : on les calcule si demandé, en gardant les arêtes vives. Pas de bassin ici, on peut être appelé à partir d'une tâche (voir AssetLoader::loadMeshes).
+		if constexpr (requires { mesh.vertices[0].normal; }) {
+			if (generateNormals and attribs.normals.empty())
+				mesh.computeNormals(defaultCreaseAngle, nullptr);
+		}
+		if constexpr (requires { mesh.vertices[0].tangent; })
+			mesh.computeTangents(nullptr);
+		mesh.computeBounds();
+		return mesh;
+	}
+
+	// Construire un sommet à partir des tableaux d'attributs de tinyobj et d'un triplet d'indices. Les normales et coordonnées de texture sont ignorées si le type de sommet n'en a pas.
+	static Vertex makeWavefrontVertex(const tinyobj::attrib_t& attribs, const tinyobj::index_t& idx) {
+		Vertex data = {};
+		// Copier la position.
+		data.position = *(const vec3*)&attribs.vertices[3 * size_t(idx.vertex_index)];
+		// Copier la normale si l'index de normales est positif.
+		if constexpr (requires { data.normal; }) {
+			if (idx.normal_index >= 0)
+				data.normal = normalize(*(const vec3*)&attribs.normals[3 * size_t(idx.normal_index)]);
+		}
+		// Copier les coordonnées de texture si l'index est positif.
+		if constexpr (requires { data.texCoords; }) {
+			if (idx.texcoord_index >= 0)
+				data.texCoords = *(const vec2*)&attribs.texcoords[2 * size_t(idx.texcoord_index)];
+		}
+		return data;
+	}
+
+	// Comme loadFromWavefrontFile, mais en passant par un cache binaire écrit à côté du fichier source (voir getWavefrontCacheFilename). Chaque type de sommet et chaque combinaison d'options a son propre fichier, pour que les variantes d'un même fichier source ne se remplacent pas l'une l'autre. Le cache est identifié par la taille, la date de modification et le hachage du contenu du fichier source; s'il est absent ou périmé, le fichier Wavefront est analysé normalement et le cache est réécrit.
+	// Quand le cache est valide, le fichier est projeté en mémoire et, si setupOnLoad est vrai, les tampons sont remplis directement à partir de la projection sans copie intermédiaire. Les vecteurs vertices et indices du mesh restent alors vides. Si setupOnLoad est faux, les données sont copiées dans les vecteurs puisque la projection est libérée au retour.
+	static std::vector<BasicMesh> loadFromWavefrontFileCached(std::string_view filename, bool setupOnLoad = true, bool weldVertices = false, bool generateNormals = false) {
+		// Construire la clé du fichier source. Le hachage du contenu est beaucoup moins coûteux que l'analyse du texte et de ses nombres à virgule.
+		std::string sourceFilename(filename);
+		MappedFile sourceFile(sourceFilename);
+		if (not sourceFile.isOpen()) {
+			std::cerr << "ERROR could not open " << sourceFilename << "\n";
+			return {};
+		}
+		MeshCacheHeader key = {};
+		key.sourceSize = sourceFile.size();
+		key.sourceWriteTime = std::filesystem::last_write_time(sourceFilename).time_since_epoch().count();
+		key.sourceHash = hashBytes(sourceFile.data(), sourceFile.size());
+		key.vertexLayoutHash = hashVertexLayout<Vertex>();
+		key.weldedVertices = weldVertices;
+		key.generatedNormals = generateNormals;
+		sourceFile.close();
+
+		std::string cacheFilename = getWavefrontCacheFilename(sourceFilename, key);
+
+		// Essayer de charger à partir du cache.
+		MappedFile cacheFile(cacheFilename);
+		if (cacheFile.isOpen()) {
+			auto entries = readMeshCache(cacheFile, key);
+			if (not entries.empty()) {
+				std::vector<BasicMesh> result;
+				for (auto&& entry : entries) {
+					auto vertexData = (const Vertex*)(cacheFile.data() + entry.vertexOffset);
+					auto indexData = (const GLuint*)(cacheFile.data() + entry.indexOffset);
+					BasicMesh mesh;
+					if (setupOnLoad) {
+						mesh.setupFromData(vertexData, entry.numVertices, indexData, entry.numIndices);
+					} else {
+						mesh.vertices.assign(vertexData, vertexData + entry.numVertices);
+						mesh.indices.assign(indexData, indexData + entry.numIndices);
+						// Comme au chargement sans cache, sinon le mesh serait éliminé par le frustum culling jusqu'à setup().
+						mesh.computeBounds();
+					}
+					result.push_back(std::move(mesh));
+				}
+				return result;
+			}
+		}
+		cacheFile.close();
+
+		// Cache absent ou périmé : analyser le fichier source et réécrire le cache.
+		auto result = loadFromWavefrontFileParallel(filename, false, weldVertices, generateNormals);
+		if (not result.empty())
+			writeMeshCache(cacheFilename, key, result);
+		if (setupOnLoad) {
+			for (auto&& mesh : result)
+				mesh.setup();
+		}
 		return result;
 	}
+
+	// Le nom du cache d'un fichier source : le nom du fichier suivi du hachage de la disposition des sommets et des options, par exemple « sphere.obj.1f3a5c7e9b2d4f60.w1n0.meshcache ».
+	static std::string getWavefrontCacheFilename(const std::string& sourceFilename, const MeshCacheHeader& key) {
+		return std::format("{}.{:016x}.w{}n{}.meshcache", sourceFilename, key.vertexLayoutHash, key.weldedVertices, key.generatedNormals);
+	}
+
+	// Valider l'en-tête d'un cache projeté en mémoire par rapport à la clé attendue. Retourne la table des objets, vide si le cache est invalide.
+	static std::vector<MeshCacheEntry> readMeshCache(const MappedFile& cacheFile, const MeshCacheHeader& key) {
+		if (cacheFile.size() < sizeof(MeshCacheHeader))
+			return {};
+		MeshCacheHeader header;
+		std::memcpy(&header, cacheFile.data(), sizeof(header));
+
+		MeshCacheHeader expected = {};
+		bool isValid = std::memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0 and
+		               header.version == expected.version and
+		               header.vertexLayoutHash == key.vertexLayoutHash and
+		               header.sourceSize == key.sourceSize and
+		               header.sourceWriteTime == key.sourceWriteTime and
+		               header.sourceHash == key.sourceHash and
+		               header.weldedVertices == key.weldedVertices and
+		               header.generatedNormals == key.generatedNormals and
+		               header.numMeshes != 0;
+		size_t tableEnd = sizeof(MeshCacheHeader) + header.numMeshes * sizeof(MeshCacheEntry);
+		if (not isValid or cacheFile.size() < tableEnd)
+			return {};
+
+		std::vector<MeshCacheEntry> entries(header.numMeshes);
+		std::memcpy(entries.data(), cacheFile.data() + sizeof(MeshCacheHeader), entries.size() * sizeof(MeshCacheEntry));
+		// Vérifier que les données de chaque objet sont bien dans le fichier (un fichier tronqué serait autrement lu hors limites).
+		for (auto&& entry : entries) {
+			bool inBounds = entry.vertexOffset + entry.numVertices * sizeof(Vertex) <= cacheFile.size() and
+			                entry.indexOffset + entry.numIndices * sizeof(GLuint) <= cacheFile.size();
+			if (not inBounds)
+				return {};
+		}
+		return entries;
+	}
+
+	// Écrire le cache binaire. On écrit dans un fichier temporaire puis on le renomme pour ne jamais laisser un cache à moitié écrit si l'application est interrompue.
+	static bool writeMeshCache(const std::string& cacheFilename, const MeshCacheHeader& key, const std::vector<BasicMesh>& meshes, const std::vector<float>& simplificationErrors = {}) {
+		auto alignUp = [](uint64_t offset) { return (offset + 15) / 16 * 16; };
+
+		MeshCacheHeader header = key;
+		header.numMeshes = (uint32_t)meshes.size();
+
+		// Calculer la disposition des données avant de les écrire.
+		std::vector<MeshCacheEntry> entries;
+		uint64_t offset = alignUp(sizeof(MeshCacheHeader) + meshes.size() * sizeof(MeshCacheEntry));
+		for (auto&& mesh : meshes) {
+			MeshCacheEntry entry = {};
+			entry.vertexOffset = offset;
+			entry.numVertices = mesh.vertices.size();
+			offset = alignUp(offset + entry.numVertices * sizeof(Vertex));
+			entry.indexOffset = offset;
+			entry.numIndices = mesh.indices.size();
+			offset = alignUp(offset + entry.numIndices * sizeof(GLuint));
+			if (entries.size() < simplificationErrors.size())
+				entry.simplificationError = simplificationErrors[entries.size()];
+			entries.push_back(entry);
+		}
+
+		std::string tempFilename = cacheFilename + ".tmp";
+		{
+			std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+			if (not file)
+				return false;
+			auto padTo = [&](uint64_t target) {
+				static const char zeros[16] = {};
+				file.write(zeros, target - (uint64_t)file.tellp());
+			};
+			file.write((const char*)&header, sizeof(header));
+			file.write((const char*)entries.data(), entries.size() * sizeof(MeshCacheEntry));
+			for (size_t i = 0; i < meshes.size(); i++) {
+				padTo(entries[i].vertexOffset);
+				file.write((const char*)meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(Vertex));
+				padTo(entries[i].indexOffset);
+				file.write((const char*)meshes[i].indices.data(), meshes[i].indices.size() * sizeof(GLuint));
+			}
+			padTo(offset);
+			if (not file)
+				return false;
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempFilename, cacheFilename, error);
+		if (error) {
+			std::cerr << "WARNING could not write mesh cache " << cacheFilename << ": " << error.message() << "\n";
+			std::filesystem::remove(tempFilename, error);
+			return false;
+		}
+		return true;
+	}
 };
 
+// Le mesh habituel, avec les sommets complets (position, normale, coords de texture, couleur).
+using Mesh = BasicMesh<VertexData>;
+
+// Un mesh avec des tangentes, pour le placage de normales.
+using TangentMesh = BasicMesh<TangentVertexData>;
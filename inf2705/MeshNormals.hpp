@@ -0,0 +1,265 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+#include "utils.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Appeler func(i) pour chaque i dans [begin, end), réparti entre les fils de `pool`, ou dans le fil courant si pool est nul (par exemple à partir d'une tâche du bassin, qui ne doit pas attendre d'autres tâches).
+template <typename Func>
+inline void forEachIndex(ThreadPool* pool, size_t begin, size_t end, Func&& func, size_t minBlockSize) {
+	if (pool != nullptr) {
+		pool->parallelFor(begin, end, func, minBlockSize);
+		return;
+	}
+	for (size_t i = begin; i < end; i++)
+		func(i);
+}
+
+// Additionner en parallèle des contributions par triangle dans un tableau de numTargets éléments (un par sommet, par position, etc.). contribute(t, add) appelle add(target, value) pour chaque contribution du triangle t.
+// Les triangles voisins touchent les mêmes éléments, on ne peut donc pas écrire dans un tableau commun sans synchronisation. Chaque bloc de triangles (un par fil) accumule plutôt dans son propre tableau de sommes partielles, puis on additionne les tableaux partiels entre eux. Cette réduction est une addition de longs tableaux de float contigus, que le compilateur vectorise.
+template <typename T, typename Contribute>
+inline std::vector<T> accumulateTriangleContributions(size_t numTriangles, size_t numTargets, Contribute&& contribute, ThreadPool* pool) {
+	static_assert(std::is_trivially_copyable_v<T> and sizeof(T) % sizeof(float) == 0, "T must be made of floats only");
+	// Pas la peine de multiplier les tableaux partiels pour un petit mesh, ni sans bassin.
+	size_t numBlocks = pool != nullptr ? std::clamp<size_t>(numTriangles / 4096, 1, pool->getNumThreads()) : 1;
+	size_t blockSize = (numTriangles + numBlocks - 1) / numBlocks;
+	std::vector<std::vector<T>> partialSums(numBlocks);
+	auto accumulateBlock = [&](size_t b) {
+		auto& sums = partialSums[b];
+		sums.assign(numTargets, T{});
+		auto add = [&sums](size_t target, const T& value) { sums[target] += value; };
+		size_t end = std::min(numTriangles, (b + 1) * blockSize);
+		for (size_t t = b * blockSize; t < end; t++)
+			contribute(t, add);
+	};
+	if (numBlocks == 1) {
+		accumulateBlock(0);
+	} else {
+		std::vector<std::future<void>> pending;
+		for (size_t b = 0; b < numBlocks; b++)
+			pending.push_back(pool->submit([&accumulateBlock, b]() { accumulateBlock(b); }));
+		for (auto&& f : pending)
+			f.get();
+	}
+
+	std::vector<T> result = std::move(partialSums[0]);
+	if (numBlocks > 1) {
+		constexpr size_t chunkSize = 16384;
+		size_t numChunks = (numTargets + chunkSize - 1) / chunkSize;
+		pool->parallelFor(0, numChunks, [&](size_t chunk) {
+			size_t first = chunk * chunkSize;
+			size_t numFloats = (std::min(numTargets, first + chunkSize) - first) * (sizeof(T) / sizeof(float));
+			float* out = (float*)(result.data() + first);
+			for (size_t b = 1; b < numBlocks; b++) {
+				const float* in = (const float*)(partialSums[b].data() + first);
+				for (size_t i = 0; i < numFloats; i++)
+					out[i] += in[i];
+			}
+		});
+	}
+	return result;
+}
+
+// Numéroter les positions distinctes des sommets. Deux sommets à la même position avec des attributs différents (par exemple de part et d'autre d'une couture de texture) reçoivent le même numéro, pour que les normales soient lissées au travers de la couture.
+// Les positions sont comparées bit à bit, comme elles sont hachées, après avoir ramené -0 à +0 (p + 0 donne +0 pour les deux zéros). Comparer avec == tout en hachant les octets donnerait deux hachages différents pour des clés égales.
+template <typename Vertex>
+inline std::vector<uint32_t> findUniquePositions(const std::vector<Vertex>& vertices, size_t& numPositions) {
+	auto hash = [](const vec3& p) { return (size_t)hashBytes(&p, sizeof(p)); };
+	auto isSameBits = [](const vec3& a, const vec3& b) { return std::memcmp(&a, &b, sizeof(a)) == 0; };
+	std::unordered_map<vec3, uint32_t, decltype(hash), decltype(isSameBits)> ids(vertices.size(), hash, isSameBits);
+	std::vector<uint32_t> positionIds(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++)
+		positionIds[v] = ids.try_emplace(vertices[v].position + vec3(0.0f), (uint32_t)ids.size()).first->second;
+	numPositions = ids.size();
+	return positionIds;
+}
+
+// L'angle du coin `corner` (0, 1 ou 2) d'un triangle.
+inline float getCornerAngle(vec3 p0, vec3 p1, vec3 p2, int corner) {
+	vec3 a = corner == 0 ? p1 - p0 : corner == 1 ? p2 - p1 : p0 - p2;
+	vec3 b = corner == 0 ? p2 - p0 : corner == 1 ? p0 - p1 : p1 - p2;
+	float lengths = length(a) * length(b);
+	if (lengths <= 0)
+		return 0;
+	return std::acos(std::clamp(dot(a, b) / lengths, -1.0f, 1.0f));
+}
+
+// Calculer des normales lisses pour un mesh de triangles (avec ou sans tableau d'indices). La normale d'un sommet est la moyenne des normales des triangles qui le touchent, pondérée par l'aire du triangle et par l'angle du coin : l'aire donne plus de poids aux grandes faces et l'angle rend le résultat indépendant de la façon dont une face plane est découpée en triangles.
+// Deux triangles dont les normales font un angle de plus de creaseAngleDegrees ne sont pas lissés ensemble, ce qui garde les arêtes vives (le coin d'un cube par exemple). Un sommet indexé partagé par des triangles de part et d'autre d'une arête vive est alors dédoublé : des sommets peuvent être ajoutés et les indices modifiés. Avec 180 degrés ou plus, tout est lissé et rien n'est dédoublé.
+// Les triangles sont répartis entre les fils de `pool` (nullptr pour tout faire dans le fil courant, par exemple à partir d'une tâche du bassin).
+template <typename Vertex>
+inline void computeVertexNormals(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, float creaseAngleDegrees = 180, ThreadPool* pool = &ThreadPool::getDefault()) {
+	bool isIndexed = not indices.empty();
+	size_t numTriangles = isIndexed ? indices.size() / 3 : vertices.size() / 3;
+	size_t numCorners = numTriangles * 3;
+	auto cornerVertex = [&](size_t corner) { return isIndexed ? indices[corner] : (GLuint)corner; };
+	size_t numPositions = 0;
+	std::vector<uint32_t> positionIds = findUniquePositions(vertices, numPositions);
+
+	// Normale unitaire de chaque triangle et poids (aire * angle) de chacun de ses coins. Le produit vectoriel des arêtes a une longueur de deux fois l'aire.
+	std::vector<vec3> faceNormals(numTriangles);
+	std::vector<float> cornerWeights(numCorners);
+	forEachIndex(pool, 0, numTriangles, [&](size_t t) {
+		vec3 p0 = vertices[cornerVertex(t * 3 + 0)].position;
+		vec3 p1 = vertices[cornerVertex(t * 3 + 1)].position;
+		vec3 p2 = vertices[cornerVertex(t * 3 + 2)].position;
+		vec3 n = cross(p1 - p0, p2 - p0);
+		float doubleArea = length(n);
+		faceNormals[t] = doubleArea > 0 ? n / doubleArea : vec3(0);
+		for (int c = 0; c < 3; c++)
+			cornerWeights[t * 3 + c] = doubleArea * getCornerAngle(p0, p1, p2, c);
+	}, 1024);
+
+	if (creaseAngleDegrees >= 180) {
+		// Tout lisser : une seule somme par position.
+		std::vector<vec3> sums = accumulateTriangleContributions<vec3>(numTriangles, numPositions, [&](size_t t, auto&& add) {
+			for (size_t c = t * 3; c < t * 3 + 3; c++)
+				add(positionIds[cornerVertex(c)], faceNormals[t] * cornerWeights[c]);
+		}, pool);
+		forEachIndex(pool, 0, vertices.size(), [&](size_t v) {
+			vec3 sum = sums[positionIds[v]];
+			if (dot(sum, sum) > 0)
+				vertices[v].normal = normalize(sum);
+		}, 4096);
+		return;
+	}
+
+	// Avec des arêtes vives, chaque coin a sa propre normale : la somme des triangles autour de la même position dont la normale est assez proche de celle de son triangle. On trouve d'abord les coins de chaque position (tri par dénombrement), puis on calcule la normale de chaque coin en parallèle.
+	std::vector<uint32_t> positionOffsets(numPositions + 1, 0);
+	for (size_t c = 0; c < numCorners; c++)
+		positionOffsets[positionIds[cornerVertex(c)] + 1]++;
+	for (size_t p = 0; p < numPositions; p++)
+		positionOffsets[p + 1] += positionOffsets[p];
+	std::vector<uint32_t> positionCorners(numCorners);
+	{
+		std::vector<uint32_t> cursor(positionOffsets.begin(), positionOffsets.end() - 1);
+		for (size_t c = 0; c < numCorners; c++)
+			positionCorners[cursor[positionIds[cornerVertex(c)]]++] = (uint32_t)c;
+	}
+
+	float cosCrease = std::cos(radians(creaseAngleDegrees));
+	std::vector<vec3> cornerNormals(numCorners);
+	forEachIndex(pool, 0, numCorners, [&](size_t c) {
+		vec3 faceNormal = faceNormals[c / 3];
+		uint32_t p = positionIds[cornerVertex(c)];
+		vec3 sum = vec3(0);
+		for (uint32_t i = positionOffsets[p]; i < positionOffsets[p + 1]; i++) {
+			uint32_t other = positionCorners[i];
+			if (dot(faceNormals[other / 3], faceNormal) >= cosCrease)
+				sum += faceNormals[other / 3] * cornerWeights[other];
+		}
+		cornerNormals[c] = dot(sum, sum) > 0 ? normalize(sum) : faceNormal;
+	}, 4096);
+
+	// Donner sa normale à chaque sommet. Un sommet dont les coins ont des normales différentes est dédoublé; les copies d'un même sommet sont chaînées par nextCopy pour réutiliser une copie qui a déjà la bonne normale.
+	size_t numOriginalVertices = vertices.size();
+	std::vector<bool> isAssigned(numOriginalVertices, false);
+	std::vector<GLuint> nextCopy(numOriginalVertices, GLuint(-1));
+	for (size_t c = 0; c < numCorners; c++) {
+		GLuint v = cornerVertex(c);
+		const vec3& normal = cornerNormals[c];
+		if (not isAssigned[v]) {
+			vertices[v].normal = normal;
+			isAssigned[v] = true;
+			continue;
+		}
+		GLuint u = v;
+		while (dot(vertices[u].normal, normal) < 0.9999f) {
+			if (nextCopy[u] == GLuint(-1)) {
+				nextCopy[u] = (GLuint)vertices.size();
+				nextCopy.push_back(GLuint(-1));
+				Vertex copy = vertices[v];
+				copy.normal = normal;
+				vertices.push_back(copy);
+			}
+			u = nextCopy[u];
+		}
+		if (isIndexed)
+			indices[c] = u;
+	}
+}
+
+// Les sommes par sommet pour le calcul des tangentes.
+struct TangentSums
+{
+	vec3 tangent;
+	vec3 bitangent;
+
+	TangentSums& operator+=(const TangentSums& other) {
+		tangent += other.tangent;
+		bitangent += other.bitangent;
+		return *this;
+	}
+};
+
+// Calculer les tangentes pour le placage de normales (normal mapping). Les sommets doivent déjà avoir des normales et des coordonnées de texture. On suit les conventions de MikkTSpace (celles de Blender, xNormal, Substance, etc.) pour que les textures de normales générées par ces outils s'affichent correctement :
+// - la tangente de chaque triangle (direction de u croissant) est projetée dans le plan de la normale de chaque sommet, normalisée et pondérée par l'angle du coin;
+// - tangent.w (+1 ou -1) donne le sens de la bitangente, à reconstruire dans le nuanceur sans normaliser ce qui a été interpolé : bitangent = tangent.w * cross(normal, tangent.xyz).
+// Contrairement à MikkTSpace, un sommet partagé par des triangles de sens opposés (texture en miroir) n'est pas dédoublé; il vaut mieux souder les sommets en gardant les coutures de texture, ce que fait loadFromWavefrontFile.
+// Comme pour computeVertexNormals, pool peut être nul pour tout faire dans le fil courant.
+template <typename Vertex>
+inline void computeVertexTangents(std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, ThreadPool* pool = &ThreadPool::getDefault()) {
+	bool isIndexed = not indices.empty();
+	size_t numTriangles = isIndexed ? indices.size() / 3 : vertices.size() / 3;
+	auto cornerVertex = [&](size_t corner) { return isIndexed ? indices[corner] : (GLuint)corner; };
+
+	std::vector<TangentSums> sums = accumulateTriangleContributions<TangentSums>(numTriangles, vertices.size(), [&](size_t t, auto&& add) {
+		GLuint v[3] = {cornerVertex(t * 3 + 0), cornerVertex(t * 3 + 1), cornerVertex(t * 3 + 2)};
+		vec3 p0 = vertices[v[0]].position;
+		vec3 p1 = vertices[v[1]].position;
+		vec3 p2 = vertices[v[2]].position;
+		vec2 uv0 = vertices[v[0]].texCoords;
+		vec3 e1 = p1 - p0;
+		vec3 e2 = p2 - p0;
+		vec2 d1 = vertices[v[1]].texCoords - uv0;
+		vec2 d2 = vertices[v[2]].texCoords - uv0;
+		float det = d1.x * d2.y - d2.x * d1.y;
+		if (std::abs(det) < 1e-20f)
+			return;
+		// Les dérivées de la position selon u et v, qui donnent la tangente et la bitangente du triangle.
+		vec3 dpdu = (e1 * d2.y - e2 * d1.y) / det;
+		vec3 dpdv = (e2 * d1.x - e1 * d2.x) / det;
+		for (int c = 0; c < 3; c++) {
+			vec3 n = vertices[v[c]].normal;
+			vec3 tangent = dpdu - n * dot(n, dpdu);
+			vec3 bitangent = dpdv - n * dot(n, dpdv);
+			float angle = getCornerAngle(p0, p1, p2, c);
+			TangentSums contribution = {};
+			if (dot(tangent, tangent) > 0)
+				contribution.tangent = normalize(tangent) * angle;
+			if (dot(bitangent, bitangent) > 0)
+				contribution.bitangent = normalize(bitangent) * angle;
+			add(v[c], contribution);
+		}
+	}, pool);
+
+	forEachIndex(pool, 0, vertices.size(), [&](size_t v) {
+		vec3 n = vertices[v].normal;
+		vec3 tangent = sums[v].tangent - n * dot(n, sums[v].tangent);
+		// Pas de coordonnées de texture utilisables : n'importe quelle direction perpendiculaire à la normale.
+		if (dot(tangent, tangent) <= 1e-12f)
+			tangent = std::abs(n.x) < 0.9f ? cross(n, vec3(1, 0, 0)) : cross(n, vec3(0, 1, 0));
+		tangent = dot(tangent, tangent) > 0 ? normalize(tangent) : vec3(1, 0, 0);
+		float handedness = dot(cross(n, tangent), sums[v].bitangent) < 0 ? -1.0f : 1.0f;
+		vertices[v].tangent = vec4(tangent, handedness);
+	}, 4096);
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Statistiques d'utilisation du cache de sommets post-transformation pour un tableau d'indices de triangles.
+struct VertexCacheStats
+{
+	float acmr = 0; // Average Cache Miss Ratio : nombre moyen d'exécutions du nuanceur de sommets par triangle (entre 0.5 et 3, plus bas est mieux).
+	float atvr = 0; // Average Transformed Vertex Ratio : nombre moyen d'exécutions du nuanceur de sommets par sommet utilisé (1 est l'optimum).
+};
+
+// Résultat de Mesh::optimize().
+struct MeshOptimizationStats
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+// Simuler un cache FIFO de cacheSize sommets (le modèle habituel des GPU) sur un tableau d'indices de triangles.
+inline VertexCacheStats computeVertexCacheStats(const std::vector<GLuint>& indices, size_t numVertices, int cacheSize = 16) {
+	if (indices.size() < 3 or numVertices == 0)
+		return {};
+
+	// Moment (en nombre d'échecs) où chaque sommet est entré dans le cache. Un sommet est dans le cache si moins de cacheSize échecs ont eu lieu depuis.
+	std::vector<size_t> entryTime(numVertices, 0);
+	std::vector<bool> isUsed(numVertices, false);
+	size_t numMisses = 0;
+	for (GLuint v : indices) {
+		isUsed[v] = true;
+		if (entryTime[v] == 0 or numMisses - entryTime[v] >= (size_t)cacheSize) {
+			numMisses++;
+			entryTime[v] = numMisses;
+		}
+	}
+
+	size_t numUsedVertices = std::count(isUsed.begin(), isUsed.end(), true);
+	VertexCacheStats stats;
+	stats.acmr = (float)numMisses / (indices.size() / 3);
+	stats.atvr = (float)numMisses / numUsedVertices;
+	return stats;
+}
+
+// Réordonner les triangles pour la localité dans le cache de sommets avec l'algorithme Tipsify (Sander, Nehab et Barczak, « Fast Triangle Reordering for Vertex Locality and Reduced Overdraw », SIGGRAPH 2007).
+// On émet tous les triangles autour d'un sommet pivot (un éventail), puis on choisit comme prochain pivot un des sommets qu'on vient d'émettre qui est encore dans le cache. Si clusterStarts est non nul, on y met l'indice (en triangles) du début de chaque groupe de triangles : un nouveau groupe commence quand l'algorithme doit sauter à un sommet hors cache.
+inline std::vector<GLuint> optimizeVertexCacheTipsify(const std::vector<GLuint>& indices, size_t numVertices, int cacheSize = 16, std::vector<size_t>* clusterStarts = nullptr) {
+	size_t numTriangles = indices.size() / 3;
+
+	// Construire la liste des triangles adjacents à chaque sommet (en format compact : décalage + tableau).
+	std::vector<size_t> adjacencyOffsets(numVertices + 1, 0);
+	for (GLuint v : indices)
+		adjacencyOffsets[v + 1]++;
+	std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+	std::vector<GLuint> adjacency(indices.size());
+	{
+		std::vector<size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < numTriangles * 3; i++)
+			adjacency[fill[indices[i]]++] = GLuint(i / 3);
+	}
+
+	// Le nombre de triangles pas encore émis autour de chaque sommet.
+	std::vector<int> liveTriangles(numVertices);
+	for (size_t v = 0; v < numVertices; v++)
+		liveTriangles[v] = int(adjacencyOffsets[v + 1] - adjacencyOffsets[v]);
+
+	std::vector<size_t> cacheTime(numVertices, 0);
+	std::vector<bool> isEmitted(numTriangles, false);
+	// Les sommets récemment émis, dans lesquels on pige quand on arrive à un cul-de-sac.
+	std::vector<GLuint> deadEndStack;
+	std::vector<GLuint> candidates;
+	size_t time = cacheSize + 1;
+	size_t cursor = 0;
+
+	std::vector<GLuint> result;
+	result.reserve(numTriangles * 3);
+
+	// Prendre le prochain sommet qui a encore des triangles, d'abord parmi les sommets récemment émis, sinon dans l'ordre du tableau.
+	auto skipDeadEnd = [&]() -> int64_t {
+		while (not deadEndStack.empty()) {
+			GLuint v = deadEndStack.back();
+			deadEndStack.pop_back();
+			if (liveTriangles[v] > 0)
+				return v;
+		}
+		for (; cursor < numVertices; cursor++) {
+			if (liveTriangles[cursor] > 0)
+				return (int64_t)cursor;
+		}
+		return -1;
+	};
+
+	int64_t fanVertex = skipDeadEnd();
+	if (clusterStarts != nullptr and fanVertex >= 0)
+		clusterStarts->push_back(0);
+	while (fanVertex >= 0) {
+		candidates.clear();
+		// Émettre tous les triangles restants autour du pivot.
+		for (size_t a = adjacencyOffsets[fanVertex]; a < adjacencyOffsets[fanVertex + 1]; a++) {
+			GLuint t = adjacency[a];
+			if (isEmitted[t])
+				continue;
+			for (int c = 0; c < 3; c++) {
+				GLuint v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEndStack.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				// Le sommet n'était plus dans le cache, il y entre maintenant.
+				if (time - cacheTime[v] > (size_t)cacheSize)
+					cacheTime[v] = time++;
+			}
+			isEmitted[t] = true;
+		}
+
+		// Choisir le prochain pivot parmi les candidats : celui qui est le plus ancien dans le cache tout en y restant après avoir émis ses triangles restants (chaque triangle ajoute au plus 2 sommets). Un candidat qui en sortirait a une priorité nulle et n'est jamais choisi : comme dans l'article, on passe alors au cul-de-sac.
+		int64_t best = -1;
+		size_t bestPriority = 0;
+		for (GLuint v : candidates) {
+			if (liveTriangles[v] <= 0)
+				continue;
+			size_t priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= (size_t)cacheSize)
+				priority = time - cacheTime[v];
+			if (priority > bestPriority) {
+				best = v;
+				bestPriority = priority;
+			}
+		}
+		if (best < 0) {
+			best = skipDeadEnd();
+			if (clusterStarts != nullptr and best >= 0)
+				clusterStarts->push_back(result.size() / 3);
+		}
+		fanVertex = best;
+	}
+
+	return result;
+}
+
+// Réordonner les groupes de triangles (donnés par optimizeVertexCacheTipsify) pour réduire le surdessin (overdraw) : les groupes qui font face vers l'extérieur de l'objet sont tracés en premier, ce qui permet au test de profondeur hâtif d'éliminer plus de fragments cachés derrière eux. Les groupes commencent déjà avec un cache vide, donc leur ordre ne change presque pas l'efficacité du cache.
+// getPosition(v) doit retourner la position (vec3) du sommet v.
+template <typename GetPosition>
+inline std::vector<GLuint> optimizeOverdraw(const std::vector<GLuint>& indices, const std::vector<size_t>& clusterStarts, GetPosition&& getPosition) {
+	size_t numTriangles = indices.size() / 3;
+	size_t numClusters = clusterStarts.size();
+	if (numClusters <= 1)
+		return indices;
+
+	// Le centre de l'objet, pondéré par l'aire des triangles.
+	auto triangleInfo = [&](size_t t, vec3& centroid, vec3& areaNormal) {
+		vec3 p0 = getPosition(indices[t * 3 + 0]);
+		vec3 p1 = getPosition(indices[t * 3 + 1]);
+		vec3 p2 = getPosition(indices[t * 3 + 2]);
+		centroid = (p0 + p1 + p2) / 3.0f;
+		areaNormal = cross(p1 - p0, p2 - p0);
+	};
+	vec3 meshCenter = {};
+	float meshArea = 0;
+	for (size_t t = 0; t < numTriangles; t++) {
+		vec3 centroid, areaNormal;
+		triangleInfo(t, centroid, areaNormal);
+		float area = length(areaNormal);
+		meshCenter += centroid * area;
+		meshArea += area;
+	}
+	if (meshArea > 0)
+		meshCenter /= meshArea;
+
+	// Pour chaque groupe, mesurer à quel point il fait face vers l'extérieur par rapport au centre de l'objet.
+	std::vector<float> sortKeys(numClusters);
+	for (size_t c = 0; c < numClusters; c++) {
+		size_t end = (c + 1 < numClusters) ? clusterStarts[c + 1] : numTriangles;
+		vec3 clusterCenter = {};
+		vec3 clusterNormal = {};
+		float clusterArea = 0;
+		for (size_t t = clusterStarts[c]; t < end; t++) {
+			vec3 centroid, areaNormal;
+			triangleInfo(t, centroid, areaNormal);
+			float area = length(areaNormal);
+			clusterCenter += centroid * area;
+			clusterNormal += areaNormal;
+			clusterArea += area;
+		}
+		if (clusterArea > 0)
+			clusterCenter /= clusterArea;
+		float normalLength = length(clusterNormal);
+		sortKeys[c] = normalLength > 0 ? dot(clusterCenter - meshCenter, clusterNormal / normalLength) : 0;
+	}
+
+	std::vector<size_t> order(numClusters);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<GLuint> result;
+	result.reserve(indices.size());
+	for (size_t c : order) {
+		size_t end = (c + 1 < numClusters) ? clusterStarts[c + 1] : numTriangles;
+		result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + end * 3);
+	}
+	return result;
+}
+
+// Calculer une renumérotation des sommets dans l'ordre de leur première utilisation dans le tableau d'indices, pour que le GPU lise le tampon de sommets de façon presque séquentielle. Les sommets jamais utilisés sont placés à la fin.
+inline std::vector<GLuint> computeVertexFetchRemap(const std::vector<GLuint>& indices, size_t numVertices) {
+	const GLuint unassigned = GLuint(-1);
+	std::vector<GLuint> remap(numVertices, unassigned);
+	GLuint next = 0;
+	for (GLuint v : indices) {
+		if (remap[v] == unassigned)
+			remap[v] = next++;
+	}
+	for (auto&& newIndex : remap) {
+		if (newIndex == unassigned)
+			newIndex = next++;
+	}
+	return remap;
+}
@@ -0,0 +1,399 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <future>
+#include <iterator>
+#include <numeric>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "OrbitCamera.hpp"
+#include "ThreadPool.hpp"
+#include "utils.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Quadrique d'erreur (Garland et Heckbert, « Surface Simplification Using Quadric Error Metrics », SIGGRAPH 1997) : la somme des carrés des distances d'un point à un ensemble de plans, sous forme de matrice 4x4 symétrique (on garde seulement les 10 coefficients distincts). On utilise des double, les float perdent trop de précision quand on additionne beaucoup de plans.
+struct Quadric
+{
+	// xx, xy, xz, xw, yy, yz, yw, zz, zw, ww
+	std::array<double, 10> m = {};
+
+	// Ajouter le plan dot(n, p) + d = 0 (n unitaire).
+	void addPlane(dvec3 n, double d) {
+		m[0] += n.x * n.x; m[1] += n.x * n.y; m[2] += n.x * n.z; m[3] += n.x * d;
+		m[4] += n.y * n.y; m[5] += n.y * n.z; m[6] += n.y * d;
+		m[7] += n.z * n.z; m[8] += n.z * d;
+		m[9] += d * d;
+	}
+
+	Quadric& operator+=(const Quadric& other) {
+		for (int i = 0; i < 10; i++)
+			m[i] += other.m[i];
+		return *this;
+	}
+
+	// La somme des carrés des distances de p aux plans.
+	double evaluate(dvec3 p) const {
+		double x = p.x, y = p.y, z = p.z;
+		return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+		     + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+		     + m[7] * z * z + 2 * m[8] * z
+		     + m[9];
+	}
+};
+
+// Simplifier un mesh de triangles indexé (par exemple chargé avec weldVertices) jusqu'à environ targetRatio de ses triangles, par fusions d'arêtes ordonnées selon l'erreur quadrique.
+// On fait des fusions de demi-arête : un sommet est déplacé sur un de ses voisins, qui existe déjà. Les sommets restants gardent donc exactement leurs attributs (normales, coords de texture), sans interpolation. Pour préserver l'apparence :
+// - Les sommets sur une couture de texture (plusieurs sommets à la même position avec des attributs différents) et sur un bord ne bougent jamais. Une couture apparaît comme un bord dans le tableau d'indices, il suffit donc de trouver les arêtes utilisées par un seul triangle.
+// - Deux sommets dont les normales diffèrent de plus de maxNormalAngleDegrees ne sont pas fusionnés, ce qui garde les arêtes vives.
+// - Une fusion qui renverserait un triangle, ou qui ne respecte pas la condition de lien (ce qui rendrait la surface non manifold), est refusée.
+// Si resultError est non nul, on y met l'erreur géométrique de la simplification, soit la racine de la plus grande erreur quadrique acceptée (une distance dans l'espace de l'objet).
+template <typename Vertex>
+inline BasicMesh<Vertex> simplifyMesh(const BasicMesh<Vertex>& mesh, float targetRatio, float* resultError = nullptr, float maxNormalAngleDegrees = 60) {
+	size_t numVertices = mesh.vertices.size();
+	size_t numTriangles = mesh.indices.size() / 3;
+	size_t targetTriangles = std::max<size_t>(1, size_t(numTriangles * std::clamp(targetRatio, 0.0f, 1.0f)));
+	if (resultError != nullptr)
+		*resultError = 0;
+
+	std::vector<std::array<GLuint, 3>> triangles(numTriangles);
+	for (size_t t = 0; t < numTriangles; t++)
+		triangles[t] = {mesh.indices[t * 3 + 0], mesh.indices[t * 3 + 1], mesh.indices[t * 3 + 2]};
+	auto position = [&](GLuint v) { return dvec3(mesh.vertices[v].position); };
+
+	// Trouver les sommets à verrouiller : ceux des arêtes qui n'appartiennent qu'à un triangle (bords et coutures).
+	std::vector<bool> isLocked(numVertices, false);
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(numTriangles * 3);
+		for (auto&& tri : triangles) {
+			for (int c = 0; c < 3; c++) {
+				GLuint a = tri[c], b = tri[(c + 1) % 3];
+				edges.push_back((uint64_t)std::min(a, b) << 32 | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size();) {
+			size_t j = i;
+			while (j < edges.size() and edges[j] == edges[i])
+				j++;
+			if (j - i == 1) {
+				isLocked[edges[i] >> 32] = true;
+				isLocked[edges[i] & 0xFFFFFFFF] = true;
+			}
+			i = j;
+		}
+	}
+
+	// Quadrique de chaque sommet : les plans de ses triangles adjacents. Liste des triangles adjacents à chaque sommet.
+	std::vector<Quadric> quadrics(numVertices);
+	std::vector<std::vector<GLuint>> vertexTriangles(numVertices);
+	for (size_t t = 0; t < numTriangles; t++) {
+		auto& tri = triangles[t];
+		dvec3 p0 = position(tri[0]);
+		dvec3 normal = cross(position(tri[1]) - p0, position(tri[2]) - p0);
+		double len = length(normal);
+		if (len > 0) {
+			normal /= len;
+			for (GLuint v : tri)
+				quadrics[v].addPlane(normal, -dot(normal, p0));
+		}
+		for (GLuint v : tri)
+			vertexTriangles[v].push_back(GLuint(t));
+	}
+
+	struct Collapse
+	{
+		double cost;
+		GLuint from;
+		GLuint to;
+		uint32_t fromVersion;
+		uint32_t toVersion;
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+	// Chaque modification d'un sommet incrémente sa version, ce qui invalide les fusions déjà dans la file qui le concernent (plus simple que de les retirer).
+	std::vector<uint32_t> versions(numVertices, 0);
+	std::vector<bool> isRemoved(numVertices, false);
+	std::vector<bool> isTriangleRemoved(numTriangles, false);
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+	float minNormalDot = std::cos(radians(maxNormalAngleDegrees));
+	auto pushCollapse = [&](GLuint from, GLuint to) {
+		if (isLocked[from] or from == to)
+			return;
+		if constexpr (requires { mesh.vertices[0].normal; }) {
+			if (dot(mesh.vertices[from].normal, mesh.vertices[to].normal) < minNormalDot)
+				return;
+		}
+		queue.push({quadrics[from].evaluate(position(to)), from, to, versions[from], versions[to]});
+	};
+	// Les voisins d'un sommet, sans doublons (chaque arête intérieure est partagée par deux triangles).
+	std::vector<GLuint> neighbors;
+	// Pour la condition de lien.
+	std::vector<GLuint> fromRing;
+	std::vector<GLuint> commonRing;
+	std::vector<GLuint> edgeOpposites;
+	auto findNeighbors = [&](GLuint v) {
+		neighbors.clear();
+		for (GLuint t : vertexTriangles[v]) {
+			if (isTriangleRemoved[t])
+				continue;
+			for (GLuint other : triangles[t]) {
+				if (other != v)
+					neighbors.push_back(other);
+			}
+		}
+		std::sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+	};
+	auto pushVertexCollapses = [&](GLuint v) {
+		findNeighbors(v);
+		for (GLuint other : neighbors)
+			pushCollapse(v, other);
+	};
+	for (GLuint v = 0; v < numVertices; v++)
+		pushVertexCollapses(v);
+
+	size_t numLiveTriangles = numTriangles;
+	double maxCost = 0;
+	// Une fusion refusée parce qu'elle renversait un triangle n'est pas remise dans la file, mais elle peut devenir valide quand le voisinage change. Si la file se vide avant d'atteindre la cible, on la remplit de nouveau avec toutes les fusions possibles (tant que ça permet d'avancer).
+	size_t numLiveAtRefill = SIZE_MAX;
+	while (numLiveTriangles > targetTriangles) {
+		if (queue.empty()) {
+			if (numLiveTriangles == numLiveAtRefill)
+				break;
+			numLiveAtRefill = numLiveTriangles;
+			for (GLuint v = 0; v < numVertices; v++) {
+				if (not isRemoved[v])
+					pushVertexCollapses(v);
+			}
+			continue;
+		}
+
+		Collapse collapse = queue.top();
+		queue.pop();
+		GLuint from = collapse.from;
+		GLuint to = collapse.to;
+		if (isRemoved[from] or isRemoved[to] or versions[from] != collapse.fromVersion or versions[to] != collapse.toVersion)
+			continue;
+
+		// Les listes d'adjacence des voisins peuvent encore contenir des triangles disparus lors d'une fusion précédente.
+		std::erase_if(vertexTriangles[from], [&](GLuint t) { return isTriangleRemoved[t]; });
+
+		// Vérifier que l'arête existe encore et qu'aucun triangle restant ne serait renversé ou aplati.
+		bool isValid = true;
+		bool isEdge = false;
+		for (GLuint t : vertexTriangles[from]) {
+			auto& tri = triangles[t];
+			if (std::find(tri.begin(), tri.end(), to) != tri.end()) {
+				isEdge = true;
+				continue;
+			}
+			std::array<dvec3, 3> p = {position(tri[0]), position(tri[1]), position(tri[2])};
+			dvec3 before = cross(p[1] - p[0], p[2] - p[0]);
+			for (int c = 0; c < 3; c++) {
+				if (tri[c] == from)
+					p[c] = position(to);
+			}
+			dvec3 after = cross(p[1] - p[0], p[2] - p[0]);
+			if (dot(before, after) <= 0.0001 * dot(before, before)) {
+				isValid = false;
+				break;
+			}
+		}
+		if (not isValid or not isEdge)
+			continue;
+
+		// Condition de lien (link condition, Dey et coll. 1999) : les voisins communs de `from` et `to` doivent être seulement les sommets opposés à l'arête dans ses triangles. Un autre voisin commun w formerait, après la fusion, une arête (to, w) partagée par plus de deux triangles ou des triangles en double : la surface ne serait plus une variété (par exemple un tétraèdre aplati, ou un tunnel refermé).
+		std::erase_if(vertexTriangles[to], [&](GLuint t) { return isTriangleRemoved[t]; });
+		edgeOpposites.clear();
+		for (GLuint t : vertexTriangles[from]) {
+			auto& tri = triangles[t];
+			if (std::find(tri.begin(), tri.end(), to) == tri.end())
+				continue;
+			for (GLuint v : tri) {
+				if (v != from and v != to)
+					edgeOpposites.push_back(v);
+			}
+		}
+		findNeighbors(from);
+		fromRing = neighbors;
+		findNeighbors(to);
+		commonRing.clear();
+		std::set_intersection(fromRing.begin(), fromRing.end(), neighbors.begin(), neighbors.end(), std::back_inserter(commonRing));
+		bool isLinkValid = std::all_of(commonRing.begin(), commonRing.end(), [&](GLuint v) {
+			return std::find(edgeOpposites.begin(), edgeOpposites.end(), v) != edgeOpposites.end();
+		});
+		if (not isLinkValid)
+			continue;
+
+		// Faire la fusion : les triangles qui contiennent l'arête disparaissent, les autres passent au sommet `to`.
+		for (GLuint t : vertexTriangles[from]) {
+			auto& tri = triangles[t];
+			if (std::find(tri.begin(), tri.end(), to) != tri.end()) {
+				isTriangleRemoved[t] = true;
+				numLiveTriangles--;
+			} else {
+				std::replace(tri.begin(), tri.end(), from, to);
+				vertexTriangles[to].push_back(t);
+			}
+		}
+		std::erase_if(vertexTriangles[to], [&](GLuint t) { return isTriangleRemoved[t]; });
+		vertexTriangles[from].clear();
+		isRemoved[from] = true;
+		quadrics[to] += quadrics[from];
+		versions[to]++;
+		maxCost = std::max(maxCost, collapse.cost);
+
+		// Les fusions à partir de `to` et vers `to` ont changé.
+		pushVertexCollapses(to);
+		for (GLuint other : neighbors)
+			pushCollapse(other, to);
+	}
+
+	// Construire le mesh résultant avec seulement les sommets encore utilisés, dans l'ordre de leur première utilisation.
+	BasicMesh<Vertex> result;
+	std::vector<GLuint> remap(numVertices, GLuint(-1));
+	result.indices.reserve(numLiveTriangles * 3);
+	for (size_t t = 0; t < numTriangles; t++) {
+		if (isTriangleRemoved[t])
+			continue;
+		for (GLuint v : triangles[t]) {
+			if (remap[v] == GLuint(-1)) {
+				remap[v] = (GLuint)result.vertices.size();
+				result.vertices.push_back(mesh.vertices[v]);
+			}
+			result.indices.push_back(remap[v]);
+		}
+	}
+
+	result.computeBounds();
+	if (resultError != nullptr)
+		*resultError = (float)std::sqrt(std::max(maxCost, 0.0));
+	return result;
+}
+
+// Une chaîne de niveaux de détail (LOD) d'un mesh : le niveau 0 est le mesh original, les suivants sont de plus en plus simplifiés. On trace le niveau le plus simple dont l'erreur géométrique, projetée à l'écran, reste sous un seuil en pixels.
+template <typename Vertex>
+struct BasicLodChain
+{
+	std::vector<BasicMesh<Vertex>> levels;
+	// Erreur géométrique de chaque niveau (distance dans l'espace de l'objet), croissante.
+	std::vector<float> errors;
+
+	// Construire les niveaux à partir d'un mesh qui a ses sommets et indices en mémoire (chargé avec setupOnLoad à faux et weldVertices à vrai). Chaque niveau est simplifié à partir du mesh original, indépendamment des autres, donc tous en parallèle sur `pool` (nullptr pour tout faire dans le fil courant, par exemple à partir d'une tâche du bassin).
+	static BasicLodChain build(const BasicMesh<Vertex>& mesh, const std::vector<float>& ratios = {0.5f, 0.25f, 0.125f}, ThreadPool* pool = &ThreadPool::getDefault()) {
+		struct Level
+		{
+			BasicMesh<Vertex> mesh;
+			float error = 0;
+		};
+		auto simplify = [&mesh](float ratio) {
+			Level level;
+			level.mesh = simplifyMesh(mesh, ratio, &level.error);
+			return level;
+		};
+		std::vector<std::future<Level>> pending;
+		if (pool != nullptr) {
+			for (float ratio : ratios)
+				pending.push_back(pool->submit([&simplify, ratio]() { return simplify(ratio); }));
+		}
+
+		BasicLodChain chain;
+		chain.levels.push_back({});
+		chain.levels[0].vertices = mesh.vertices;
+		chain.levels[0].indices = mesh.indices;
+		chain.levels[0].computeBounds();
+		chain.errors.push_back(0);
+		for (size_t i = 0; i < ratios.size(); i++) {
+			Level level = pool != nullptr ? pending[i].get() : simplify(ratios[i]);
+			chain.levels.push_back(std::move(level.mesh));
+			// Garder les erreurs croissantes même si un niveau plus simple a eu moins d'erreur que le précédent.
+			chain.errors.push_back(std::max(level.error, chain.errors.back()));
+		}
+		return chain;
+	}
+
+	// Comme build(), mais en gardant les niveaux dans un cache binaire (même format que Mesh::loadFromWavefrontFileCached). Le cache est identifié par le hachage des sommets, des indices et des ratios (par convention, on le nomme comme le fichier source suivi de « .lodcache »).
+	static BasicLodChain buildCached(const BasicMesh<Vertex>& mesh, const std::string& cacheFilename, const std::vector<float>& ratios = {0.5f, 0.25f, 0.125f}, ThreadPool* pool = &ThreadPool::getDefault()) {
+		MeshCacheHeader key = {};
+		key.vertexLayoutHash = hashVertexLayout<Vertex>();
+		key.sourceSize = mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(GLuint);
+		key.sourceHash = hashBytes(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+		key.sourceHash = hashBytes(mesh.indices.data(), mesh.indices.size() * sizeof(GLuint), key.sourceHash);
+		key.sourceHash = hashBytes(ratios.data(), ratios.size() * sizeof(float), key.sourceHash);
+
+		MappedFile cacheFile(cacheFilename);
+		if (cacheFile.isOpen()) {
+			auto entries = BasicMesh<Vertex>::readMeshCache(cacheFile, key);
+			if (entries.size() == ratios.size() + 1) {
+				BasicLodChain chain;
+				for (auto&& entry : entries) {
+					auto vertexData = (const Vertex*)(cacheFile.data() + entry.vertexOffset);
+					auto indexData = (const GLuint*)(cacheFile.data() + entry.indexOffset);
+					BasicMesh<Vertex> level;
+					level.vertices.assign(vertexData, vertexData + entry.numVertices);
+					level.indices.assign(indexData, indexData + entry.numIndices);
+					level.computeBounds();
+					chain.levels.push_back(std::move(level));
+					chain.errors.push_back(entry.simplificationError);
+				}
+				return chain;
+			}
+		}
+		cacheFile.close();
+
+		BasicLodChain chain = build(mesh, ratios, pool);
+		BasicMesh<Vertex>::writeMeshCache(cacheFilename, key, chain.levels, chain.errors);
+		return chain;
+	}
+
+	void setup(GLenum usageMode = GL_STATIC_DRAW) {
+		for (auto&& level : levels)
+			level.setup(usageMode);
+	}
+
+	// Choisir le niveau selon la distance entre la caméra et l'objet. La taille d'une unité à l'écran (en pixels) à cette distance vient de la matrice de projection en perspective : projection[1][1] vaut 1/tan(fovy/2).
+	size_t selectLevel(float distance, const mat4& projection, float viewportHeight, float maxPixelError = 1) const {
+		if (levels.empty())
+			return 0;
+		float pixelsPerUnit = projection[1][1] * viewportHeight / 2 / std::max(distance, 1e-4f);
+		size_t level = 0;
+		while (level + 1 < levels.size() and errors[level + 1] * pixelsPerUnit <= maxPixelError)
+			level++;
+		return level;
+	}
+
+	// Pour un objet au point de mire d'une caméra orbitale, la distance est simplement l'altitude de la caméra.
+	size_t selectLevel(const OrbitCamera& camera, const mat4& projection, float viewportHeight, float maxPixelError = 1) const {
+		return selectLevel(camera.altitude, projection, viewportHeight, maxPixelError);
+	}
+
+	void draw(size_t level, GLenum drawMode = GL_TRIANGLES) {
+		if (level < levels.size())
+			levels[level].draw(drawMode);
+	}
+
+	void deleteObjects() {
+		for (auto&& level : levels)
+			level.deleteObjects();
+	}
+};
+
+using LodChain = BasicLodChain<VertexData>;
@@ -0,0 +1,173 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+
+using namespace glm;
+
+
+// Un niveau de détail calculé sur le CPU, en RGBA de 8 bits, rangées dans le même ordre que l'image d'origine.
+struct MipLevel
+{
+	ivec2 size = {};
+	std::vector<uint8_t> pixels;
+};
+
+// Le nombre de niveaux d'une chaîne complète (jusqu'à 1x1).
+inline int getNumMipLevels(ivec2 size) {
+	int numLevels = 1;
+	for (int largest = std::max(size.x, size.y); largest > 1; largest /= 2)
+		numLevels++;
+	return numLevels;
+}
+
+// La taille du niveau `level` : la moitié du précédent dans chaque dimension, arrondie vers le bas, sans descendre sous 1 (comme glTexStorage2D).
+inline ivec2 getMipLevelSize(ivec2 size, int level) {
+	return {std::max(size.x >> level, 1), std::max(size.y >> level, 1)};
+}
+
+// Les tables de conversion entre les valeurs de 8 bits et l'intensité linéaire.
+// Les images couleur sont encodées en sRGB : la valeur 128 est bien moins que la moitié de l'intensité de 255. Faire la moyenne des valeurs encodées assombrit les mipmaps là où il y a du contraste (un damier noir et blanc devient gris foncé plutôt que gris moyen). On convertit donc en intensité linéaire avant de filtrer, puis on réencode.
+struct MipmapColorTables
+{
+	std::array<float, 256> toLinear;
+	// Les seuils en linéaire entre deux valeurs sRGB consécutives : la valeur encodée la plus proche d'une intensité est le nombre de seuils qui lui sont inférieurs. C'est exact, contrairement à une table indexée par l'intensité qui manque de précision dans les tons foncés.
+	std::array<float, 255> thresholds;
+
+	static float srgbToLinear(float c) {
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	template <typename Decode>
+	static MipmapColorTables make(Decode&& decode) {
+		MipmapColorTables result;
+		for (int i = 0; i < 256; i++)
+			result.toLinear[i] = decode(i / 255.0f);
+		for (int i = 0; i < 255; i++)
+			result.thresholds[i] = decode((i + 0.5f) / 255.0f);
+		return result;
+	}
+
+	static const MipmapColorTables& getSrgb() {
+		static const MipmapColorTables tables = make(srgbToLinear);
+		return tables;
+	}
+
+	// Pour les données qui ne sont pas des couleurs (alpha, normales, rugosité, etc.).
+	static const MipmapColorTables& getLinear() {
+		static const MipmapColorTables tables = make([](float c) { return c; });
+		return tables;
+	}
+
+	uint8_t fromLinear(float value) const {
+		return uint8_t(std::upper_bound(thresholds.begin(), thresholds.end(), value) - thresholds.begin());
+	}
+};
+
+// Les texels sources d'un texel de destination le long d'un axe, avec leur poids. Quand la taille source est impaire, chaque texel de destination couvre 2 texels et demi de la source : le filtre boîte en prend 3 avec des poids partiels plutôt que d'ignorer la dernière rangée ou colonne, ce qui décalerait l'image.
+struct MipmapTaps
+{
+	std::array<int, 4> indices = {};
+	std::array<float, 4> weights = {};
+	int count = 0;
+};
+
+inline std::vector<MipmapTaps> computeMipmapTaps(int srcSize, int dstSize) {
+	std::vector<MipmapTaps> result(dstSize);
+	float scale = float(srcSize) / dstSize;
+	for (int d = 0; d < dstSize; d++) {
+		float begin = d * scale;
+		float end = begin + scale;
+		auto& taps = result[d];
+		for (int s = int(begin); s < srcSize and s < end and taps.count < 4; s++) {
+			float overlap = std::min(end, s + 1.0f) - std::max(begin, float(s));
+			if (overlap <= 0)
+				continue;
+			taps.indices[taps.count] = s;
+			taps.weights[taps.count] = overlap / scale;
+			taps.count++;
+		}
+	}
+	return result;
+}
+
+// Calculer un niveau à partir du précédent avec un filtre boîte, dans l'espace linéaire si isSrgb (l'alpha est toujours linéaire). Les rangées de destination sont réparties entre les fils de `pool` (nullptr pour tout faire dans le fil courant, par exemple à partir d'une tâche du bassin).
+inline MipLevel downsampleMipLevel(const uint8_t* src, ivec2 srcSize, bool isSrgb = true, ThreadPool* pool = &ThreadPool::getDefault()) {
+	MipLevel result;
+	result.size = getMipLevelSize(srcSize, 1);
+	result.pixels.resize(size_t(result.size.x) * result.size.y * 4);
+	auto columns = computeMipmapTaps(srcSize.x, result.size.x);
+	auto rows = computeMipmapTaps(srcSize.y, result.size.y);
+	const auto& colorTables = isSrgb ? MipmapColorTables::getSrgb() : MipmapColorTables::getLinear();
+	const auto& alphaTables = MipmapColorTables::getLinear();
+	const std::array<const MipmapColorTables*, 4> tables = {&colorTables, &colorTables, &colorTables, &alphaTables};
+
+	// Accumuler la rangée de destination en float dans `sums`, rangée source par rangée source. La boucle sur les 4 canaux, sans branchement, est vectorisée par le compilateur.
+	auto filterRow = [&](size_t y, std::vector<float>& sums) {
+		std::fill(sums.begin(), sums.end(), 0.0f);
+		auto& rowTaps = rows[y];
+		for (int ty = 0; ty < rowTaps.count; ty++) {
+			const uint8_t* srcRow = src + size_t(rowTaps.indices[ty]) * srcSize.x * 4;
+			for (int x = 0; x < result.size.x; x++) {
+				auto& columnTaps = columns[x];
+				float* sum = &sums[size_t(x) * 4];
+				for (int tx = 0; tx < columnTaps.count; tx++) {
+					const uint8_t* texel = srcRow + size_t(columnTaps.indices[tx]) * 4;
+					float weight = rowTaps.weights[ty] * columnTaps.weights[tx];
+					float values[4] = {colorTables.toLinear[texel[0]], colorTables.toLinear[texel[1]], colorTables.toLinear[texel[2]], alphaTables.toLinear[texel[3]]};
+					for (int c = 0; c < 4; c++)
+						sum[c] += weight * values[c];
+				}
+			}
+		}
+		uint8_t* dstRow = result.pixels.data() + y * result.size.x * 4;
+		for (int x = 0; x < result.size.x; x++) {
+			for (int c = 0; c < 4; c++)
+				dstRow[x * 4 + c] = tables[c]->fromLinear(sums[size_t(x) * 4 + c]);
+		}
+	};
+
+	// Les rangées sont traitées par blocs qui réutilisent le même tampon d'accumulation, plutôt que d'en allouer un par rangée.
+	constexpr size_t rowsPerBlock = 16;
+	size_t numRows = result.size.y;
+	size_t numBlocks = (numRows + rowsPerBlock - 1) / rowsPerBlock;
+	auto filterBlock = [&](size_t block) {
+		std::vector<float> sums(size_t(result.size.x) * 4);
+		for (size_t y = block * rowsPerBlock; y < std::min(numRows, (block + 1) * rowsPerBlock); y++)
+			filterRow(y, sums);
+	};
+
+	if (pool != nullptr)
+		pool->parallelFor(0, numBlocks, filterBlock);
+	else
+		for (size_t block = 0; block < numBlocks; block++)
+			filterBlock(block);
+	return result;
+}
+
+// Calculer les niveaux 1 à numLevels - 1 à partir des pixels du niveau 0 (qui ne sont pas copiés). Chaque niveau est calculé à partir du précédent, déjà quatre fois plus petit. Le résultat ne dépend pas du pilote, contrairement à glGenerateMipmap dont le filtre n'est pas spécifié par OpenGL.
+// Le filtre est symétrique : renverser l'image avant ou après donne les mêmes niveaux, on peut donc calculer les niveaux d'une image dont la première rangée est le haut et les renverser à l'envoi comme le niveau 0.
+inline std::vector<MipLevel> generateMipmapChain(const uint8_t* pixels, ivec2 size, int numLevels, bool isSrgb = true, ThreadPool* pool = &ThreadPool::getDefault()) {
+	std::vector<MipLevel> levels;
+	numLevels = std::min(numLevels, getNumMipLevels(size));
+	levels.reserve(std::max(numLevels - 1, 0));
+	const uint8_t* src = pixels;
+	ivec2 srcSize = size;
+	for (int level = 1; level < numLevels; level++) {
+		levels.push_back(downsampleMipLevel(src, srcSize, isSrgb, pool));
+		src = levels.back().pixels.data();
+		srcSize = levels.back().size;
+	}
+	return levels;
+}
@@ -13,6 +13,7 @@
 #include <stdexcept>
 #include <string>
 #include <chrono>
+#include <cstdlib>
 #include <unordered_map>
 #include <thread>
 
@@ -27,7 +28,10 @@
 #include <SFML/Window.hpp>
 #include <SFML/Graphics.hpp>
 
+#include "AssetLoader.hpp"
+#include "GpuMemory.hpp"
 #include "sfml_utils.hpp"
+#include "UploadThread.hpp"
 #include "utils.hpp"
 
 
@@ -39,6 +43,12 @@ struct WindowSettings
 	sf::VideoMode videoMode = sf::VideoMode({600, 600});
 	int fps = 30;
 	sf::ContextSettings context = sf::ContextSettings(24, 8);
+	// Nombre maximal d'octets envoyés en mémoire graphique par trame pour les ressources chargées en arrière-plan (voir getAssetLoader).
+	size_t uploadBudgetPerFrame = 16 * 1024 * 1024;
+	// Créer un deuxième contexte partagé dans un fil d'envoi (voir UploadThread) pour que les ressources chargées en arrière-plan soient envoyées hors de la trame.
+	bool useUploadThread = false;
+	// Si positif, la fenêtre se ferme d'elle-même après ce nombre de trames, en passant par la même fermeture que le X de la fenêtre. Sert de test de fumée sans interaction, par exemple sans écran avec le pilote logiciel de Mesa (llvmpipe) : INF2705_SMOKE_FRAMES=60 LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./C08_Intro_GeoTess. La variable d'environnement INF2705_SMOKE_FRAMES remplace cette valeur.
+	int maxFrames = 0;
 };
 
 // Classe de base pour les application OpenGL. Fait pour nous la création de fenêtre et la gestion des événements.
@@ -55,6 +65,8 @@ public:
 		argv_ = argv;
 
 		settings_ = settings;
+		if (const char* smokeFrames = std::getenv("INF2705_SMOKE_FRAMES"))
+			settings_.maxFrames = std::atoi(smokeFrames);
 
 		// Créer la fenêtre et afficher les infos du contexte OpenGL.
 		createWindowAndContext(title);
@@ -78,6 +90,9 @@ public:
 
 		// Tant que la fenêtre est ouverte (mis à jour dans la gestion d'événements) :
 		while (window_.isOpen()) {
+			// Envoyer en mémoire graphique une partie des ressources qui ont fini d'être chargées en arrière-plan.
+			assetLoader_.processUploads(settings_.uploadBudgetPerFrame);
+
 			drawFrame(); // À surcharger
 
 			// SFML fait le rafraîchissement de la fenêtre ainsi que le contrôle du framerate pour nous.
@@ -88,11 +103,19 @@ public:
 			updateDeltaTime();
 
 			frame_++;
+			if (settings_.maxFrames > 0 and frame_ >= settings_.maxFrames and window_.isOpen())
+				close();
 		}
 	}
 
 	const sf::Window& getWindow() const { return window_; }
 
+	// Le chargeur de ressources en arrière-plan, dont les envois en mémoire graphique sont faits au début de chaque trame.
+	AssetLoader& getAssetLoader() { return assetLoader_; }
+
+	// Le fil d'envoi avec un contexte partagé, s'il a été demandé dans WindowSettings::useUploadThread et a pu être créé.
+	UploadThread& getUploadThread() { return uploadThread_; }
+
 	// État de la souris (mis à jour une fois par trame avant la gestion d'événements).
 	const MouseState& getMouse() const {
 		return currentMouseState_;
@@ -266,10 +289,7 @@ protected:
 
 			// L'utilisateur a voulu fermer la fenêtre (le X de la fenêtre, Alt+F4 sur Windows, etc.).
 			if (event->is<sf::Event::Closed>()) {
-				glFinish();
-				onClose(); // À surcharger
-				glFinish();
-				window_.close();
+				close();
 			// Redimensionnement de la fenêtre.
 			} else if (auto* e = event->getIf<sf::Event::Resized>()) {
 				glViewport(0, 0, e->size.x, e->size.y);
@@ -300,6 +320,19 @@ protected:
 		}
 	}
 
+	void close() {
+		// Arrêter le fil d'envoi en premier : ses tâches en cours créent encore des objets, et les ressources qu'elles remplissent ne doivent pas être libérées avant la fin de leur envoi.
+		assetLoader_.setUploadThread(nullptr);
+		uploadThread_.stop();
+		glFinish();
+		onClose(); // À surcharger
+		assetLoader_.deleteObjects();
+		glFinish();
+		// Tout devrait avoir été libéré dans onClose.
+		GpuMemoryRegistry::getDefault().reportLeaks();
+		window_.close();
+	}
+
 	void createWindowAndContext(std::string_view title) {
 		#ifdef _WIN32
 			// Juste pour s'assurer d'avoir le codepage UTF-8 sur Windows avec Visual Studio.
@@ -323,6 +356,14 @@ protected:
 		// On peut donner une « GetProcAddress » venant d'une autre librairie à glbinding.
 		// Si on met nullptr, glbinding se débrouille avec sa propre implémentation.
 		glbinding::Binding::initialize(nullptr, true);
+
+		// Le contexte du fil d'envoi doit être créé après celui de la fenêtre pour partager ses objets.
+		if (settings_.useUploadThread) {
+			if (uploadThread_.start())
+				assetLoader_.setUploadThread(&uploadThread_);
+			else
+				std::cerr << "WARNING could not create the upload thread, uploads will be done in the main thread" << "\n";
+		}
 	}
 
 	void updateDeltaTime() {
@@ -346,6 +387,8 @@ protected:
 	char** argv_ = nullptr;
 	WindowSettings settings_;
 	std::string keybindMessage_;
+	UploadThread uploadThread_;
+	AssetLoader assetLoader_;
 };
 
 
@@ -0,0 +1,169 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "Bounds.hpp"
+#include "Mesh.hpp"
+#include "ShaderProgram.hpp"
+#include "utils.hpp"
+#include "VertexLayout.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Sommet compressé sans couleur (16 octets au lieu des 48 de VertexData).
+struct PackedVertexData
+{
+	u16vec4 position;  // layout(location = 0), position normalisée dans la boîte englobante du mesh (w sert seulement à aligner sur 4 octets et n'est pas lu).
+	i16vec2 normal;    // layout(location = 1), normale encodée en octaèdre (voir encodeOctahedral).
+	u16vec2 texCoords; // layout(location = 2), demi-flottants.
+};
+
+// Sommet compressé avec couleur (20 octets).
+struct PackedColorVertexData
+{
+	u16vec4 position;  // layout(location = 0)
+	i16vec2 normal;    // layout(location = 1)
+	u16vec2 texCoords; // layout(location = 2)
+	u8vec4 color;      // layout(location = 3), couleur normalisée sur 8 bits par composante.
+};
+
+static_assert(sizeof(PackedVertexData) == 16);
+static_assert(sizeof(PackedColorVertexData) == 20);
+
+// Mêmes localisations que VertexData, mais avec des types normalisés : OpenGL convertit les entiers en float lors de la lecture des sommets, le nuanceur reçoit donc toujours des vec.
+template <>
+struct VertexLayout<PackedVertexData>
+{
+	static constexpr std::array attribs = {
+		makeNormalizedVertexAttrib<u16vec4>(0, offsetof(PackedVertexData, position), 3),
+		makeNormalizedVertexAttrib<i16vec2>(1, offsetof(PackedVertexData, normal)),
+		makeHalfVertexAttrib<u16vec2>(2, offsetof(PackedVertexData, texCoords)),
+	};
+};
+
+template <>
+struct VertexLayout<PackedColorVertexData>
+{
+	static constexpr std::array attribs = {
+		makeNormalizedVertexAttrib<u16vec4>(0, offsetof(PackedColorVertexData, position), 3),
+		makeNormalizedVertexAttrib<i16vec2>(1, offsetof(PackedColorVertexData, normal)),
+		makeHalfVertexAttrib<u16vec2>(2, offsetof(PackedColorVertexData, texCoords)),
+		makeNormalizedVertexAttrib<u8vec4>(3, offsetof(PackedColorVertexData, color)),
+	};
+};
+
+// Encoder une normale unitaire en deux composantes dans [-1,1] en projetant sur un octaèdre puis en dépliant la moitié inférieure sur le carré (Cigolle et coll., « A Survey of Efficient Representations for Independent Unit Vectors », JCGT 2014). C'est beaucoup plus uniforme que de simplement garder x et y.
+// Le nuanceur de sommets doit décoder la normale (reçue en vec2) avec decodeOctahedral, comme dans C06_Intro_Illumination/packed_vert.glsl.
+inline vec2 encodeOctahedral(vec3 n) {
+	float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (sum == 0)
+		return {0, 0};
+	n /= sum;
+	if (n.z >= 0)
+		return {n.x, n.y};
+	auto signNotZero = [](float v) { return v >= 0 ? 1.0f : -1.0f; };
+	return {
+		(1 - std::abs(n.y)) * signNotZero(n.x),
+		(1 - std::abs(n.x)) * signNotZero(n.y)
+	};
+}
+
+// Un mesh compressé est un BasicMesh ordinaire avec un des types de sommet ci-dessus : setup(), draw(), drawInstanced() et deleteObjects() sont les mêmes que pour Mesh.
+using PackedMesh = BasicMesh<PackedVertexData>;
+using PackedColorMesh = BasicMesh<PackedColorVertexData>;
+
+// La transformation qui ramène les positions quantifiées d'un mesh compressé (dans [0,1]) à leurs valeurs d'origine. Elle n'est pas dans le mesh puisqu'elle ne fait pas partie des sommets : on la garde à côté et on la donne au nuanceur avant chaque dessin, puisqu'elle change d'un mesh à l'autre.
+struct PositionDecode
+{
+	vec3 bias = {};
+	vec3 scale = vec3(1);
+
+	mat4 getMatrix() const {
+		return glm::scale(glm::translate(mat4(1.0f), bias), scale);
+	}
+
+	vec3 decode(u16vec4 position) const {
+		return bias + vec3(position) / 65535.0f * scale;
+	}
+
+	void setUniform(ShaderProgram& prog, std::string_view name = "positionDecode") const {
+		prog.use();
+		prog.setMat(name, getMatrix());
+	}
+};
+
+// Indique si au moins un sommet a une couleur non nulle, pour choisir entre PackedMesh et PackedColorMesh.
+inline bool hasVertexColors(const Mesh& mesh) {
+	return std::any_of(mesh.vertices.begin(), mesh.vertices.end(), [](const VertexData& v) { return v.color != vec4(0); });
+}
+
+// Compresser les sommets d'un mesh en PackedVertexData ou en PackedColorVertexData. Les indices sont copiés tels quels. Les positions sont quantifiées sur 16 bits dans la boîte englobante du mesh, et `decode` reçoit la transformation pour les retrouver. C06_Intro_Illumination/packed_vert.glsl est un exemple de nuanceur de sommets complet qui décode les positions et les normales; il remplace vert.glsl tel quel :
+//     PositionDecode decode;
+//     auto packed = makePackedMesh<PackedVertexData>(mesh, decode);
+//     packed.setup();
+//     prog.attachSourceFile(GL_VERTEX_SHADER, "packed_vert.glsl");
+//     ...
+//     decode.setUniform(prog);
+//     packed.draw();
+// Les volumes englobants du mesh retourné sont calculés à partir des positions décodées, donc dans l'espace de l'objet comme pour le mesh d'origine. setup() les garde tels quels, puisqu'il ne peut pas décoder les positions lui-même.
+template <typename PackedVertex>
+inline BasicMesh<PackedVertex> makePackedMesh(const Mesh& mesh, PositionDecode& decode) {
+	static_assert(std::is_same_v<PackedVertex, PackedVertexData> or std::is_same_v<PackedVertex, PackedColorVertexData>);
+	BasicMesh<PackedVertex> result;
+	result.indices = mesh.indices;
+
+	// Trouver la boîte englobante pour la quantification des positions. Une dimension plate (un plan par exemple) garde une échelle de 1 pour éviter de diviser par 0.
+	decode = {};
+	if (not mesh.vertices.empty()) {
+		vec3 minPos = mesh.vertices[0].position;
+		vec3 maxPos = mesh.vertices[0].position;
+		for (auto&& v : mesh.vertices) {
+			minPos = min(minPos, v.position);
+			maxPos = max(maxPos, v.position);
+		}
+		decode.bias = minPos;
+		decode.scale = maxPos - minPos;
+		for (int i = 0; i < 3; i++) {
+			if (decode.scale[i] <= 0)
+				decode.scale[i] = 1;
+		}
+	}
+
+	auto quantizeUnorm16 = [](float v) { return (uint16_t)std::lround(std::clamp(v, 0.0f, 1.0f) * 65535.0f); };
+	auto quantizeSnorm16 = [](float v) { return (int16_t)std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f); };
+	auto quantizeUnorm8 = [](float v) { return (uint8_t)std::lround(std::clamp(v, 0.0f, 1.0f) * 255.0f); };
+
+	result.vertices.resize(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); i++) {
+		auto& v = mesh.vertices[i];
+		auto& packed = result.vertices[i];
+		vec3 normalizedPos = (v.position - decode.bias) / decode.scale;
+		packed.position = {quantizeUnorm16(normalizedPos.x), quantizeUnorm16(normalizedPos.y), quantizeUnorm16(normalizedPos.z), 0};
+		vec2 octNormal = encodeOctahedral(v.normal);
+		packed.normal = {quantizeSnorm16(octNormal.x), quantizeSnorm16(octNormal.y)};
+		packed.texCoords = {packHalf1x16(v.texCoords.x), packHalf1x16(v.texCoords.y)};
+		if constexpr (std::is_same_v<PackedVertex, PackedColorVertexData>)
+			packed.color = {quantizeUnorm8(v.color.x), quantizeUnorm8(v.color.y), quantizeUnorm8(v.color.z), quantizeUnorm8(v.color.w)};
+	}
+
+	::computeBounds(result.vertices.size(), [&](size_t i) { return decode.decode(result.vertices[i].position); }, result.boundingBox, result.boundingSphere);
+	return result;
+}
@@ -17,6 +17,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "utils.hpp"
+#include "GpuMemory.hpp"
 #include "TransformStack.hpp"
 
 
@@ -353,6 +354,7 @@ public:
 			glGenBuffers(1, &ubo_);
 		glBindBuffer(GL_UNIFORM_BUFFER, ubo_);
 		glBufferData(GL_UNIFORM_BUFFER, sizeof(this->get()), &this->get(), usageMode);
+		recordGpuAllocation(GpuMemoryCategory::UniformBlock, ubo_, sizeof(this->get()), this->getName());
 		glBindBufferBase(GL_UNIFORM_BUFFER, bindingIndex_, ubo_);
 	}
 
@@ -371,7 +373,9 @@ public:
 	}
 
 	void deleteObject() {
+		recordGpuFree(GpuMemoryCategory::UniformBlock, ubo_);
 		glDeleteBuffers(1, &ubo_);
+		ubo_ = 0;
 	}
 
 private:
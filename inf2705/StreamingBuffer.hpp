@@ -0,0 +1,176 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <array>
+#include <iostream>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+
+#include "GpuMemory.hpp"
+#include "utils.hpp"
+
+
+using namespace gl;
+
+
+// Une sous-allocation dans un StreamingBuffer. Elle n'est valide que pour la trame pendant laquelle elle a été obtenue.
+struct StreamingAllocation
+{
+	std::byte* data = nullptr; // Où écrire les données côté CPU.
+	size_t offset = 0;         // Position (en octets) dans le tampon OpenGL.
+	size_t size = 0;
+
+	bool isValid() const { return data != nullptr; }
+};
+
+// Un grand tampon pour les données générées par le CPU à chaque trame (courbes, lignes de débogage, etc.). Le tampon est séparé en numFrames régions; à chaque trame on écrit séquentiellement dans la région suivante pendant que le GPU lit encore possiblement celles des trames précédentes. Une barrière (glFenceSync) posée à la fin de chaque trame indique quand le GPU a fini de lire la région, et on l'attend seulement quand on revient à cette région numFrames trames plus tard, ce qui n'arrive normalement jamais.
+// Avec OpenGL 4.4 (ou ARB_buffer_storage), le tampon est projeté en mémoire de façon persistante et cohérente : on écrit directement dedans, sans glBufferData ni synchronisation implicite. Sinon (par exemple macOS, limité à 4.1), on se rabat sur des glBufferSubData dans la région courante, qui reste correct mais moins efficace.
+// Usage à chaque trame :
+//     buffer.beginFrame();
+//     mesh.stream(buffer); mesh.draw(); ...
+//     buffer.endFrame();
+class StreamingBuffer
+{
+public:
+	static constexpr int maxNumFrames = 4;
+
+	StreamingBuffer() = default;
+	StreamingBuffer(const StreamingBuffer&) = delete;
+	StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+
+	// Créer le tampon avec frameSize octets par région.
+	bool create(size_t frameSize, int numFrames = 3) {
+		deleteObject();
+		if (numFrames < 1 or numFrames > maxNumFrames) {
+			std::cerr << "ERROR StreamingBuffer needs between 1 and " << maxNumFrames << " frames" << "\n";
+			return false;
+		}
+
+		frameSize_ = frameSize;
+		numFrames_ = numFrames;
+		size_t totalSize = frameSize_ * numFrames_;
+		glGenBuffers(1, &buffer_);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+		isPersistent_ = isGLVersionOrExtensionSupported(4, 4, "GL_ARB_buffer_storage");
+		if (isPersistent_) {
+			glBufferStorage(GL_ARRAY_BUFFER, totalSize, nullptr, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+			mapping_ = (std::byte*)glMapBufferRange(GL_ARRAY_BUFFER, 0, totalSize, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+			if (mapping_ == nullptr) {
+				std::cerr << "ERROR could not map streaming buffer" << "\n";
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+				deleteObject();
+				return false;
+			}
+		} else {
+			glBufferData(GL_ARRAY_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+			staging_.resize(frameSize_);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		recordGpuAllocation(GpuMemoryCategory::Buffer, buffer_, totalSize, "StreamingBuffer");
+
+		currentFrame_ = 0;
+		cursor_ = 0;
+		return true;
+	}
+
+	// Passer à la région suivante. Si le GPU n'a pas fini de lire ce qui y avait été écrit, on attend.
+	void beginFrame() {
+		GLsync& fence = fences_[currentFrame_];
+		if (fence != nullptr) {
+			// Le premier appel vide la file de commandes pour garantir que la barrière finira par être atteinte.
+			SyncObjectMask flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+			while (true) {
+				GLenum result = glClientWaitSync(fence, flags, 1'000'000'000);
+				if (result != GL_TIMEOUT_EXPIRED)
+					break;
+				flags = GL_NONE_BIT;
+			}
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+		cursor_ = 0;
+	}
+
+	// Poser la barrière de la région courante et passer à la suivante pour la prochaine trame.
+	void endFrame() {
+		fences_[currentFrame_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+		currentFrame_ = (currentFrame_ + 1) % numFrames_;
+	}
+
+	// Réserver size octets dans la région courante. La position est alignée sur un multiple de `alignment` (pas nécessairement une puissance de 2, pour pouvoir aligner sur la taille d'un sommet). Retourne une allocation invalide si la région est pleine.
+	// Il faut écrire les données dans allocation.data puis appeler commit() avant de les utiliser dans un appel de dessin.
+	StreamingAllocation allocate(size_t size, size_t alignment = 16) {
+		size_t frameBase = currentFrame_ * frameSize_;
+		size_t offset = frameBase + cursor_;
+		offset = (offset + alignment - 1) / alignment * alignment;
+		if (buffer_ == 0 or offset + size > frameBase + frameSize_) {
+			std::cerr << "ERROR streaming buffer frame is full (" << frameSize_ << " bytes)" << "\n";
+			return {};
+		}
+		cursor_ = offset + size - frameBase;
+
+		StreamingAllocation allocation;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.data = isPersistent_ ? mapping_ + offset : staging_.data() + (offset - frameBase);
+		return allocation;
+	}
+
+	// Rendre les données écrites visibles au GPU. Avec une projection cohérente, il n'y a rien à faire.
+	void commit(const StreamingAllocation& allocation) {
+		if (isPersistent_ or not allocation.isValid())
+			return;
+		glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+		glBufferSubData(GL_ARRAY_BUFFER, allocation.offset, allocation.size, allocation.data);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Réserver, copier et rendre visible en une étape.
+	StreamingAllocation write(const void* data, size_t size, size_t alignment = 16) {
+		auto allocation = allocate(size, alignment);
+		if (allocation.isValid()) {
+			std::memcpy(allocation.data, data, size);
+			commit(allocation);
+		}
+		return allocation;
+	}
+
+	void deleteObject() {
+		for (auto&& fence : fences_) {
+			if (fence != nullptr)
+				glDeleteSync(fence);
+			fence = nullptr;
+		}
+		if (mapping_ != nullptr) {
+			glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			mapping_ = nullptr;
+		}
+		recordGpuFree(GpuMemoryCategory::Buffer, buffer_);
+		glDeleteBuffers(1, &buffer_);
+		buffer_ = 0;
+		staging_ = {};
+	}
+
+	GLuint getBuffer() const { return buffer_; }
+	size_t getFrameSize() const { return frameSize_; }
+	bool isPersistent() const { return isPersistent_; }
+
+private:
+	GLuint buffer_ = 0;
+	std::byte* mapping_ = nullptr;
+	// Copie CPU de la région courante quand on ne peut pas projeter le tampon.
+	std::vector<std::byte> staging_;
+	std::array<GLsync, maxNumFrames> fences_ = {};
+	size_t frameSize_ = 0;
+	int numFrames_ = 1;
+	int currentFrame_ = 0;
+	size_t cursor_ = 0;
+	bool isPersistent_ = false;
+};
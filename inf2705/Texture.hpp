@@ -4,26 +4,70 @@
 #include <cstddef>
 #include <cstdint>
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
 #include <string>
 #include <format>
+#include <vector>
 
 #include <glbinding/gl/gl.h>
 #include <glm/glm.hpp>
 #include <SFML/Graphics.hpp>
 
+#include "GpuMemory.hpp"
+#include "MappedFile.hpp"
+#include "Mipmaps.hpp"
 #include "sfml_utils.hpp"
 #include "ShaderProgram.hpp"
+#include "TextureCompression.hpp"
+#include "ThreadPool.hpp"
+#include "utils.hpp"
 
 
 using namespace gl;
 using namespace glm;
 
 
+// Le temps de chargement d'un fichier d'image (voir Texture::loadFromFiles et loadFromMipmapFiles).
+struct TextureLoadTiming
+{
+	std::string filename;
+	double decodeMs = 0; // Lecture, décodage et calcul des niveaux de détail, dans un fil du bassin.
+	double uploadMs = 0; // Envoi en mémoire graphique, dans le fil principal.
+	bool isLoaded = false;
+};
+
+struct TextureLoadReport
+{
+	std::vector<TextureLoadTiming> files;
+	double totalMs = 0; // Le temps écoulé pour tout le lot. Les décodages se faisant en parallèle, il est plus petit que la somme des temps des fichiers.
+
+	void print(std::ostream& out = std::cout) const {
+		double decodeMs = 0, uploadMs = 0;
+		out << "Texture loading" << "\n";
+		for (auto&& file : files) {
+			out << std::format("    {:<40} decode {:>8.2f} ms, upload {:>8.2f} ms", file.filename, file.decodeMs, file.uploadMs);
+			if (not file.isLoaded)
+				out << " (failed)";
+			out << "\n";
+			decodeMs += file.decodeMs;
+			uploadMs += file.uploadMs;
+		}
+		out << std::format("    {} files in {:.2f} ms (decode {:.2f} ms, upload {:.2f} ms)", files.size(), totalMs, decodeMs, uploadMs) << "\n";
+	}
+};
+
+
 struct Texture
 {
 	GLuint id = 0; // L'objet donné par OpenGL.
 	ivec2 size = {}; // La taille de l'image sous-jacente.
 	int numLevels = 0; // Le nombre de niveaux de détails (mipmap ou manuel).
+	TextureCompression compression = TextureCompression::None; // Le format des blocs si la texture est compressée (voir loadFromFileCompressed).
+	bool isImmutable = false; // Vrai si la texture a été allouée avec glTexStorage2D (voir create).
+	bool isTopDown = false; // Vrai si la première rangée de la texture est le haut de l'image (voir loadFromPixels). Il faut alors inverser v dans le nuanceur : texture(tex, vec2(uv.x, 1 - uv.y)).
 
 	void bindToTextureUnit(int textureUnit) {
 		glActiveTexture(GL_TEXTURE0 + textureUnit);
@@ -42,6 +86,11 @@ struct Texture
 
 	void setPixelData(GLenum format, const void* data) {
 		glBindTexture(GL_TEXTURE_2D, id);
+		// On ne peut pas réallouer une texture immuable, seulement remplacer ses pixels.
+		if (isImmutable) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, format, GL_UNSIGNED_BYTE, data);
+			return;
+		}
 		glTexImage2D(
 			GL_TEXTURE_2D,
 			0,
@@ -56,77 +105,227 @@ struct Texture
 	}
 
 	void deleteObject() {
+		recordGpuFree(GpuMemoryCategory::Texture, id);
 		glDeleteTextures(1, &id);
 		id = 0;
 	}
 
-	// Si detailLevels est > 1, demande à OpenGL de générer les mipmaps.
-	static Texture loadFromImage(const sf::Image& img, int detailLevels = 1) {
-		// Beaucoup de bibliothèques importent les images avec x=0,y=0 (donc premier pixel du tableau) au coin haut-gauche de l'image. C'est la convention en graphisme, mais les textures en OpenGL ont leur origine au coin bas-gauche.
-		// SFML applique la convention origine = haut-gauche, il faut donc renverser l'image verticalement avant de la passer à OpenGL.
-		sf::Image texImg = img;
-		texImg.flipVertically();
+	// La taille en mémoire graphique de tous les niveaux de détail, en supposant 4 octets par texel (GL_RGBA). Chaque niveau est la moitié du précédent dans chaque dimension, arrondi vers le bas sans descendre sous 1.
+	static size_t computeByteSize(ivec2 size, int numLevels, size_t bytesPerTexel = 4) {
+		size_t total = 0;
+		for (int level = 0; level < std::max(numLevels, 1); level++)
+			total += size_t(std::max(size.x >> level, 1)) * std::max(size.y >> level, 1) * bytesPerTexel;
+		return total;
+	}
 
-		// Générer et lier un objet de texture. Ça ressemble un peu aux VBO.
-		Texture tex = {};
-		tex.size = {texImg.getSize().x, texImg.getSize().y};
-		tex.numLevels = detailLevels;
-		glGenTextures(1, &tex.id);
-		glBindTexture(GL_TEXTURE_2D, tex.id);
-		// Passer les données de l'image (un peu comme avec glBufferData). Il faut spécifier le format interne qui sera enregistré sur le GPU ainsi que celui dont est fait le tableau de données passé en paramètre.
-		tex.setPixelData(GL_RGBA, texImg.getPixelsPtr());
+	// Déclarer la taille de la texture au registre de mémoire graphique.
+	void recordGpuMemory(std::string_view name = {}) const {
+		size_t numBytes = 0;
+		if (compression == TextureCompression::None) {
+			numBytes = computeByteSize(size, numLevels);
+		} else {
+			for (int level = 0; level < numLevels; level++)
+				numBytes += getCompressedLevelSize(compression, getMipLevelSize(size, level));
+		}
+		recordGpuAllocation(GpuMemoryCategory::Texture, id, numBytes, name);
+	}
+
+	// Passer une bande de rangées [firstRow, firstRow + numRows) du niveau 0, par exemple pour étaler l'envoi d'une grosse image sur plusieurs trames. La texture doit déjà avoir été allouée (voir create).
+	void setPixelRows(int firstRow, int numRows, GLenum format, const void* data) {
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, size.x, numRows, format, GL_UNSIGNED_BYTE, data);
+	}
+
+	// Remplacer un rectangle du niveau `level` (déjà alloué), de coin bas-gauche `offset`. Si un tampon est lié à GL_PIXEL_UNPACK_BUFFER, `data` est une position dans ce tampon plutôt qu'un pointeur (voir TextureStreamer).
+	void setPixelRect(int level, ivec2 offset, ivec2 rectSize, GLenum format, const void* data) {
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexSubImage2D(GL_TEXTURE_2D, level, offset.x, offset.y, rectSize.x, rectSize.y, format, GL_UNSIGNED_BYTE, data);
+	}
+
+	// Passer au niveau `level` (déjà alloué) les rangées [firstRow, firstRow + numRows) d'une image dont la première rangée est le haut, en la renversant pendant l'envoi : chaque rangée est envoyée directement à sa place finale. OpenGL ne permet pas de parcourir les rangées à reculons (GL_UNPACK_ROW_LENGTH n'est pas signé), c'est donc un glTexSubImage2D par rangée, mais sans copie ni passe sur l'image côté CPU. `image` pointe sur le début de l'image complète.
+	// C'est utile quand on ne peut pas modifier les pixels reçus (voir loadFromPixels). Une image décodée dans une tâche en arrière-plan est plutôt renversée dans cette tâche (sf::Image::flipVertically), puis envoyée d'un seul appel par niveau (voir loadFromFiles).
+	void setPixelRowsFlipped(int level, ivec2 levelSize, int firstRow, int numRows, GLenum format, const void* image) {
+		glBindTexture(GL_TEXTURE_2D, id);
+		auto rows = (const uint8_t*)image;
+		size_t rowSize = size_t(levelSize.x) * 4;
+		for (int row = firstRow; row < firstRow + numRows; row++)
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, levelSize.y - 1 - row, levelSize.x, 1, format, GL_UNSIGNED_BYTE, rows + row * rowSize);
+	}
+
+	void setPixelDataFlipped(int level, ivec2 levelSize, GLenum format, const void* image) {
+		setPixelRowsFlipped(level, levelSize, 0, levelSize.y, format, image);
+	}
+
+	// Passer les niveaux 1 et plus calculés sur le CPU (voir generateMipmapChain), renversés ou non comme le niveau 0.
+	void setMipLevels(const std::vector<MipLevel>& levels, bool flipVertically = true) {
+		for (int i = 0; i < (int)levels.size() and i + 1 < numLevels; i++) {
+			if (flipVertically)
+				setPixelDataFlipped(i + 1, levels[i].size, GL_RGBA, levels[i].pixels.data());
+			else
+				setPixelRect(i + 1, {0, 0}, levels[i].size, GL_RGBA, levels[i].pixels.data());
+		}
+	}
 
-		// Le paramètre contrôle la génération automatique de mipmaps.
-		if (detailLevels > 1) {
+	// Spécifier les modes de filtrage selon le nombre de niveaux de détail.
+	void setFilteringModes() {
+		glBindTexture(GL_TEXTURE_2D, id);
+		if (numLevels > 1) {
 			// Spécifier le mode de filtrage pour la minimisation (zoom out). Si on utilise du mipmap, il faut utiliser le mode spécifique aux mipmaps (GL_NEAREST_MIPMAP_* ou GL_LINEAR_MIPMAP_*)
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
 			// Spécifier le mode de filtrage pour le grossissement (zoom in). Beaucoup de ressources en ligne font l'erreur d'utiliser GL_*_MIPMAP_* pour le grossissement. Les seules valeurs applicables sont GL_LINEAR et GL_NEAREST.
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			// Générer automatiquement les mipmaps. L'algorithme utilisé pour faire la mise à l'échelle n'est pas spécifiée dans le standard OpenGL. C'est un compromis entre la solution simple (pas de mipmap) et la solution compliqué (mipmap manuel).
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, detailLevels - 1);
-			glGenerateMipmap(GL_TEXTURE_2D);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
 		} else {
 			// Spéficier les modes de filtrage. GL_NEAREST pour la minimisation et GL_LINEAR pour le grossissement fonctionnent bien dans une majorité des cas.
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		}
+	}
+
+	// Générer les mipmaps à partir du niveau 0 si la texture en a (numLevels > 1).
+	void generateMipmaps() {
+		if (numLevels <= 1)
+			return;
+		glBindTexture(GL_TEXTURE_2D, id);
+		// Générer automatiquement les mipmaps. L'algorithme utilisé pour faire la mise à l'échelle n'est pas spécifiée dans le standard OpenGL. C'est un compromis entre la solution simple (pas de mipmap) et la solution compliqué (mipmap manuel).
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
 
+	// Créer une texture RGBA de la taille donnée sans lui passer de pixels, avec les modes de filtrage selon detailLevels (limité au nombre de niveaux d'une chaîne complète). On passe ensuite les pixels (setPixelData ou setPixelRows), puis les niveaux de détail (setMipLevels ou generateMipmaps).
+	static Texture create(ivec2 size, int detailLevels = 1) {
+		detailLevels = std::clamp(detailLevels, 1, getNumMipLevels(size));
+		// Générer et lier un objet de texture. Ça ressemble un peu aux VBO.
+		Texture tex = {};
+		tex.size = size;
+		tex.numLevels = detailLevels;
+		glGenTextures(1, &tex.id);
+		glBindTexture(GL_TEXTURE_2D, tex.id);
+		// Avec OpenGL 4.2 (ou ARB_texture_storage), on alloue tous les niveaux d'un coup avec un format interne à taille explicite. La texture est alors immuable : sa taille et ses niveaux ne changent plus, ce qui évite au pilote de vérifier à chaque utilisation que les niveaux sont complets et cohérents.
+		// Sinon (par exemple macOS, limité à 4.1), on alloue le niveau 0 sans données (un peu comme glBufferData avec nullptr), puis les autres niveaux au même format. Il faut spécifier le format interne qui sera enregistré sur le GPU ainsi que celui dont est fait le tableau de données qui sera passé.
+		if (isGLVersionOrExtensionSupported(4, 2, "GL_ARB_texture_storage")) {
+			glTexStorage2D(GL_TEXTURE_2D, detailLevels, GL_RGBA8, size.x, size.y);
+			tex.isImmutable = true;
+		} else {
+			tex.setPixelData(GL_RGBA, nullptr);
+			for (int level = 1; level < detailLevels; level++) {
+				ivec2 levelSize = getMipLevelSize(size, level);
+				glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, levelSize.x, levelSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			}
+		}
+		tex.recordGpuMemory();
+
+		tex.setFilteringModes();
+
+		return tex;
+	}
+
+	// Créer une texture à partir de pixels RGBA de 8 bits décodés (par SFML, stb_image, etc.), sans les copier.
+	// Si detailLevels est > 1, les niveaux de détail sont calculés sur le CPU avec le bassin de fils (voir generateMipmapChain) plutôt qu'avec glGenerateMipmap, dont le filtre dépend du pilote. isSrgb indique que les pixels sont des couleurs encodées en sRGB, à filtrer dans l'espace linéaire; il faut le désactiver pour les données (normales, hauteurs, etc.).
+	// Beaucoup de bibliothèques importent les images avec x=0,y=0 (donc premier pixel du tableau) au coin haut-gauche de l'image. C'est la convention en graphisme, mais les textures en OpenGL ont leur origine au coin bas-gauche. Il faut donc renverser l'image verticalement :
+	// - Si flipVertically est vrai, les rangées sont envoyées dans l'ordre inverse (voir setPixelDataFlipped).
+	// - Sinon, l'image est envoyée d'un seul appel telle quelle et la texture est marquée isTopDown : c'est au nuanceur d'inverser la coordonnée v.
+	static Texture loadFromPixels(const void* pixels, ivec2 size, int detailLevels = 1, bool flipVertically = true, bool isSrgb = true) {
+		Texture tex = create(size, detailLevels);
+		// Passer les données de l'image (un peu comme avec glBufferData).
+		if (flipVertically) {
+			tex.setPixelDataFlipped(0, size, GL_RGBA, pixels);
+		} else {
+			tex.setPixelRows(0, size.y, GL_RGBA, pixels);
+			tex.isTopDown = true;
+		}
+		tex.setMipLevels(generateMipmapChain((const uint8_t*)pixels, size, tex.numLevels, isSrgb), flipVertically);
 		return tex;
 	}
 
-	// Si detailLevels est > 1, demande à OpenGL de générer les mipmaps.
-	static Texture loadFromFile(const std::string& filename, int detailLevels = 1) {
+	// Si detailLevels est > 1, calcule les niveaux de détail (voir loadFromPixels).
+	static Texture loadFromImage(const sf::Image& img, int detailLevels = 1, bool flipVertically = true, bool isSrgb = true) {
+		// SFML applique la convention origine = haut-gauche (voir loadFromPixels). On passe directement ses pixels plutôt que de copier l'image pour la renverser.
+		return loadFromPixels(img.getPixelsPtr(), {img.getSize().x, img.getSize().y}, detailLevels, flipVertically, isSrgb);
+	}
+
+	// Si detailLevels est > 1, calcule les niveaux de détail (voir loadFromPixels pour isSrgb).
+	static Texture loadFromFile(const std::string& filename, int detailLevels = 1, bool isSrgb = true) {
 		// Lire les pixels de l'image. SFML (la bibliothèque qu'on utilise pour gérer la fenêtre) a déjà une fonctionnalité de chargement d'images. Une alternative plus légère est stb_image.
 		sf::Image texImg;
 		if (not texImg.loadFromFile(filename)) {
 			std::cerr << std::format("{} could not be loaded", filename) << "\n";
 			return {};
 		}
-		return loadFromImage(texImg, detailLevels);
+		// L'image nous appartient : on la renverse sur le CPU, ce qui coûte moins cher qu'un envoi par rangée.
+		texImg.flipVertically();
+		ivec2 size = {texImg.getSize().x, texImg.getSize().y};
+		Texture tex = create(size, detailLevels);
+		tex.setPixelRect(0, {0, 0}, size, GL_RGBA, texImg.getPixelsPtr());
+		tex.setMipLevels(generateMipmapChain(texImg.getPixelsPtr(), size, tex.numLevels, isSrgb), false);
+		GpuMemoryRegistry::getDefault().setName(GpuMemoryCategory::Texture, tex.id, filename);
+		return tex;
 	}
 
-	// filenamePattern doit contenir un "{}" qui sera remplacé par 0 à numLevels (avec un format de spécification optionnel comme en Python).
-	static Texture loadFromMipmapFiles(const std::string& filenamePattern, int numLevels) {
+	// Charger plusieurs images d'un coup. Les fichiers sont lus et décodés en parallèle sur le bassin de fils (avec leurs niveaux de détail, voir loadFromPixels), puis envoyés un par un dans l'ordre de la liste, dans le fil principal, au fur et à mesure que leur décodage se termine. Une texture dont le fichier n'a pas pu être chargé est vide (id = 0). Doit être appelée dans le fil du contexte OpenGL (pas à partir d'une tâche du bassin).
+	// Si report n'est pas nul, il reçoit le temps de décodage et d'envoi de chaque fichier.
+	static std::vector<Texture> loadFromFiles(const std::vector<std::string>& filenames, int detailLevels = 1, TextureLoadReport* report = nullptr, bool isSrgb = true, ThreadPool& pool = ThreadPool::getDefault()) {
+		auto start = std::chrono::steady_clock::now();
+		auto decoded = decodeImagesAsync(filenames, detailLevels, isSrgb, pool);
+		std::vector<Texture> result;
+		std::vector<TextureLoadTiming> timings;
+		for (size_t i = 0; i < filenames.size(); i++) {
+			// On ne garde qu'une image décodée à la fois dans ce fil : elle est libérée dès qu'elle est envoyée.
+			DecodedImage image = decoded[i].get();
+			TextureLoadTiming timing = {filenames[i], image.decodeMs, 0, image.isLoaded};
+			Texture tex = {};
+			if (image.isLoaded) {
+				auto uploadStart = std::chrono::steady_clock::now();
+				ivec2 size = {image.image.getSize().x, image.image.getSize().y};
+				tex = create(size, detailLevels);
+				// L'image a été renversée par la tâche de décodage : un seul appel par niveau.
+				tex.setPixelRect(0, {0, 0}, size, GL_RGBA, image.image.getPixelsPtr());
+				tex.setMipLevels(image.mipLevels, false);
+				GpuMemoryRegistry::getDefault().setName(GpuMemoryCategory::Texture, tex.id, filenames[i]);
+				timing.uploadMs = getElapsedMs(uploadStart);
+			} else {
+				std::cerr << std::format("{} could not be loaded", filenames[i]) << "\n";
+			}
+			result.push_back(tex);
+			timings.push_back(timing);
+		}
+		if (report != nullptr)
+			*report = {std::move(timings), getElapsedMs(start)};
+		return result;
+	}
+
+	// filenamePattern doit contenir un "{}" qui sera remplacé par 0 à numLevels (avec un format de spécification optionnel comme en Python). Les fichiers des niveaux sont décodés en parallèle (voir loadFromFiles).
+	static Texture loadFromMipmapFiles(const std::string& filenamePattern, int numLevels, TextureLoadReport* report = nullptr, ThreadPool& pool = ThreadPool::getDefault()) {
+		auto start = std::chrono::steady_clock::now();
+		// Générer les noms de fichier (du beau C++20) et lancer le décodage de tous les niveaux.
+		std::vector<std::string> filenames;
+		for (int i = 0; i < numLevels; i++)
+			filenames.push_back(std::vformat(filenamePattern, std::make_format_args(i)));
+		auto decoded = decodeImagesAsync(filenames, 1, true, pool);
+		std::vector<TextureLoadTiming> timings;
+
 		// Créer et lier l'objet de texture. Quand on fait des mipmap manuellement, il faut créer une seule texture à laquelle on passe une image différente pour chaque niveau de détail.
 		Texture result = {};
 		glGenTextures(1, &result.id);
 		glBindTexture(GL_TEXTURE_2D, result.id);
-		// Pour chaque niveau de détails:
+		// Pour chaque niveau de détails, dans l'ordre :
 		for (int i = 0; i < numLevels; i++) {
-			// Générer le nom de fichier (du beau C++20).
-			auto filename = std::vformat(filenamePattern, std::make_format_args(i));
-			// Charger l'image et la renverser verticalement (voir commentaire dans fonction précédente).
-			sf::Image texImg;
-			if (not texImg.loadFromFile(filename))
+			auto& filename = filenames[i];
+			// Attendre le décodage de l'image.
+			DecodedImage image = decoded[i].get();
+			if (not image.isLoaded) {
+				result.deleteObject();
 				throw std::runtime_error(std::format("{} could not be loaded", filename));
-			texImg.flipVertically();
-			// Passer l'image en spécifiant le niveau de détail (2e paramètre de glTexImage2D).
+			}
+			auto uploadStart = std::chrono::steady_clock::now();
+			sf::Image& texImg = image.image;
+			ivec2 levelSize = {texImg.getSize().x, texImg.getSize().y};
+			// Passer l'image en spécifiant le niveau de détail (2e paramètre de glTexImage2D). Elle a déjà été renversée verticalement par la tâche de décodage (voir loadFromPixels).
 			glTexImage2D(
 				GL_TEXTURE_2D,
 				i,
 				GL_RGBA,
-				texImg.getSize().x,
-				texImg.getSize().y,
+				levelSize.x,
+				levelSize.y,
 				0,
 				GL_RGBA,
 				GL_UNSIGNED_BYTE,
@@ -134,6 +333,7 @@ struct Texture
 			);
 			if (i == 0)
 				result.size = {texImg.getSize().x, texImg.getSize().y};
+			timings.push_back({filename, image.decodeMs, getElapsedMs(uploadStart), true});
 		}
 
 		// Spécifier le mode de filtrage. On utilise les mêmes que si on utilisait glGenerateMipmap.
@@ -145,10 +345,93 @@ struct Texture
 		// Par exemple, si on a 6 niveaux, donc 0 à 5, alors on passe 5.
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
 		result.numLevels = numLevels;
+		result.recordGpuMemory(filenamePattern);
+		if (report != nullptr)
+			*report = {std::move(timings), getElapsedMs(start)};
 
 		return result;
 	}
 
+	// Créer une texture compressée à partir des blocs de chacun de ses niveaux de détail (voir compressImage).
+	static Texture createCompressed(ivec2 size, TextureCompression format, const std::vector<const uint8_t*>& levels) {
+		Texture tex = {};
+		tex.size = size;
+		tex.numLevels = (int)levels.size();
+		tex.compression = format;
+		glGenTextures(1, &tex.id);
+		glBindTexture(GL_TEXTURE_2D, tex.id);
+		// Le GPU garde les blocs tels quels : il n'y a pas de conversion, la taille passée doit être exactement celle des blocs du niveau.
+		for (int level = 0; level < tex.numLevels; level++) {
+			ivec2 levelSize = getMipLevelSize(size, level);
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, getCompressedGLFormat(format), levelSize.x, levelSize.y, 0, (GLsizei)getCompressedLevelSize(format, levelSize), levels[level]);
+		}
+		tex.setFilteringModes();
+		tex.recordGpuMemory();
+		return tex;
+	}
+
+	// Comme loadFromFile, mais en compressant l'image (et ses niveaux de détail) dans un format par blocs. L'encodage est long : il est fait une seule fois, en parallèle sur le bassin de fils, et le résultat est mis en cache à côté de l'image (même nom suivi de « .texcache »). Le cache est identifié par la taille, la date de modification et le hachage du contenu de l'image ainsi que par les options; aux chargements suivants, les blocs sont passés directement à partir du fichier projeté en mémoire, sans décoder l'image.
+	// Si le format n'est pas offert par le contexte, la texture est chargée sans compression.
+	static Texture loadFromFileCompressed(const std::string& filename, TextureCompression format, int detailLevels = 1, bool isSrgb = true) {
+		if (not isCompressionSupported(format)) {
+			std::cerr << "WARNING texture compression format " << (int)format << " is not supported, loading " << filename << " uncompressed" << "\n";
+			return loadFromFile(filename, detailLevels, isSrgb);
+		}
+
+		MappedFile sourceFile(filename);
+		if (not sourceFile.isOpen()) {
+			std::cerr << std::format("{} could not be loaded", filename) << "\n";
+			return {};
+		}
+		TextureCacheHeader key = {};
+		key.format = (uint32_t)format;
+		key.sourceSize = sourceFile.size();
+		key.sourceWriteTime = std::filesystem::last_write_time(filename).time_since_epoch().count();
+		key.sourceHash = hashBytes(sourceFile.data(), sourceFile.size());
+		key.requestedLevels = detailLevels;
+		key.flippedVertically = true;
+		key.isSrgb = isSrgb;
+
+		std::string cacheFilename = filename + ".texcache";
+		Texture tex = {};
+		// Essayer de charger à partir du cache.
+		{
+			MappedFile cacheFile(cacheFilename);
+			TextureCacheHeader header;
+			auto cachedLevels = cacheFile.isOpen() ? readTextureCache(cacheFile, key, header) : std::vector<TextureCacheLevel>{};
+			if (not cachedLevels.empty()) {
+				std::vector<const uint8_t*> levels;
+				for (auto&& level : cachedLevels)
+					levels.push_back((const uint8_t*)cacheFile.data() + level.offset);
+				tex = createCompressed({header.width, header.height}, format, levels);
+			}
+		}
+
+		// Cache absent ou périmé : décoder l'image, calculer ses niveaux de détail, les compresser et réécrire le cache.
+		if (tex.id == 0) {
+			sf::Image image;
+			if (not image.loadFromMemory(sourceFile.data(), sourceFile.size())) {
+				std::cerr << std::format("{} could not be loaded", filename) << "\n";
+				return {};
+			}
+			ivec2 size = {image.getSize().x, image.getSize().y};
+			auto mipLevels = generateMipmapChain(image.getPixelsPtr(), size, detailLevels, isSrgb);
+			// Le renversement se fait en formant les blocs (voir compressImage).
+			std::vector<std::vector<uint8_t>> compressedLevels;
+			compressedLevels.push_back(compressImage(image.getPixelsPtr(), size, format));
+			for (auto&& level : mipLevels)
+				compressedLevels.push_back(compressImage(level.pixels.data(), level.size, format));
+			writeTextureCache(cacheFilename, key, size, compressedLevels);
+
+			std::vector<const uint8_t*> levels;
+			for (auto&& level : compressedLevels)
+				levels.push_back(level.data());
+			tex = createCompressed(size, format, levels);
+		}
+		GpuMemoryRegistry::getDefault().setName(GpuMemoryCategory::Texture, tex.id, filename);
+		return tex;
+	}
+
 	// Créer une texture de 1 pixel d'une couleur donnée.
 	static Texture createFromColor(vec4 color) {
 		Texture tex = {};
@@ -157,8 +440,44 @@ struct Texture
 		glGenTextures(1, &tex.id);
 		glBindTexture(GL_TEXTURE_2D, tex.id);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_FLOAT, &color);
+		tex.recordGpuMemory();
 		return tex;
 	}
+
+private:
+	// Une image décodée dans un fil du bassin, prête à être envoyée. Elle est déjà renversée : la première rangée est le bas, comme OpenGL l'attend.
+	struct DecodedImage
+	{
+		sf::Image image;
+		std::vector<MipLevel> mipLevels;
+		double decodeMs = 0;
+		bool isLoaded = false;
+	};
+
+	// Lancer la lecture et le décodage de chaque fichier (le renversement vertical et le calcul de ses niveaux de détail) dans une tâche du bassin. Les niveaux sont calculés dans le fil de la tâche : les fichiers sont déjà répartis entre les fils, et une tâche ne doit pas attendre d'autres tâches du même bassin.
+	static std::vector<std::future<DecodedImage>> decodeImagesAsync(const std::vector<std::string>& filenames, int detailLevels, bool isSrgb, ThreadPool& pool) {
+		std::vector<std::future<DecodedImage>> result;
+		for (auto&& filename : filenames) {
+			result.push_back(pool.submit([filename, detailLevels, isSrgb]() {
+				auto start = std::chrono::steady_clock::now();
+				DecodedImage decoded;
+				decoded.isLoaded = decoded.image.loadFromFile(filename);
+				if (decoded.isLoaded)
+					decoded.image.flipVertically();
+				if (decoded.isLoaded and detailLevels > 1) {
+					ivec2 size = {decoded.image.getSize().x, decoded.image.getSize().y};
+					decoded.mipLevels = generateMipmapChain(decoded.image.getPixelsPtr(), size, detailLevels, isSrgb, nullptr);
+				}
+				decoded.decodeMs = getElapsedMs(start);
+				return decoded;
+			}));
+		}
+		return result;
+	}
+
+	static double getElapsedMs(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
 };
 
 // Une texture liée à une variable uniforme et une unité active.
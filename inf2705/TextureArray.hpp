@@ -0,0 +1,193 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+#include <SFML/Graphics.hpp>
+
+#include "GpuMemory.hpp"
+#include "Mipmaps.hpp"
+#include "ShaderProgram.hpp"
+#include "utils.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Une texture tableau (GL_TEXTURE_2D_ARRAY) : une pile de couches de même taille et de même format, liée comme une seule texture. Le nuanceur choisit la couche à l'échantillonnage; des objets qui ont des textures différentes peuvent donc être tracés dans un même appel (instances, GeometryArena) sans changer de texture entre eux.
+// La couche vient de l'attribut textureLayer (localisation 9) : par instance dans InstanceData, par appel dans GeometryArena::addDraw (les appels d'un même glMultiDrawElementsIndirect peuvent donc avoir des couches différentes). Pour un appel sans instances, setCurrentLayer donne la valeur de l'attribut désactivé, comme un uniform. Voir layered_vert.glsl et layered_frag.glsl dans C08_Intro_GeoTess :
+//     layout(location = 9) in float i_textureLayer; // Nuanceur de sommets : textureLayer = i_textureLayer;
+//     uniform sampler2DArray texMain;              // Nuanceur de fragments, avec `flat in float textureLayer;`
+//     fragColor = texture(texMain, vec3(texCoords, textureLayer));
+// Contrairement à un atlas (voir TextureAtlas), les coordonnées de texture ne changent pas et la répétition (GL_REPEAT) fonctionne, mais toutes les images doivent avoir la même taille.
+struct TextureArray
+{
+	static constexpr GLuint layerLocation = 9; // Voir InstanceData.
+
+	GLuint id = 0;
+	ivec2 size = {}; // La taille de chaque couche.
+	int numLayers = 0;
+	int numLevels = 0;
+	std::vector<int> freeLayers; // Les couches qui ne sont pas utilisées, la plus petite à la fin.
+
+	void bindToTextureUnit(int textureUnit) const {
+		glActiveTexture(GL_TEXTURE0 + textureUnit);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+	}
+
+	void bindToTextureUnit(int textureUnit, ShaderProgram& prog, std::string_view name) const {
+		bindToTextureUnit(textureUnit);
+		prog.use();
+		prog.setInt(name, textureUnit);
+	}
+
+	// Réserver une couche libre. Retourne -1 si elles sont toutes utilisées.
+	int allocateLayer() {
+		if (freeLayers.empty())
+			return -1;
+		int layer = freeLayers.back();
+		freeLayers.pop_back();
+		return layer;
+	}
+
+	// Libérer une couche pour la réutiliser. Son contenu reste en place jusqu'à ce qu'on le remplace. Retourne faux sans rien changer si la couche n'existe pas ou est déjà libre, ce qui la donnerait deux fois à allocateLayer.
+	bool freeLayer(int layer) {
+		if (layer < 0 or layer >= numLayers) {
+			std::cerr << "ERROR texture array layer " << layer << " is out of range (" << numLayers << " layers)" << "\n";
+			return false;
+		}
+		if (std::find(freeLayers.begin(), freeLayers.end(), layer) != freeLayers.end()) {
+			std::cerr << "ERROR texture array layer " << layer << " is already free" << "\n";
+			return false;
+		}
+		freeLayers.push_back(layer);
+		std::sort(freeLayers.begin(), freeLayers.end(), std::greater<int>());
+		return true;
+	}
+
+	int getNumUsedLayers() const { return numLayers - (int)freeLayers.size(); }
+
+	// Remplacer le niveau `level` d'une couche. Si flipVertically, la première rangée est le haut de l'image et les rangées sont envoyées à l'envers (voir Texture::setPixelRowsFlipped).
+	void setLayerLevel(int layer, int level, const void* pixels, bool flipVertically = true) {
+		ivec2 levelSize = getMipLevelSize(size, level);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+		if (not flipVertically) {
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, levelSize.x, levelSize.y, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+			return;
+		}
+		auto rows = (const uint8_t*)pixels;
+		size_t rowSize = size_t(levelSize.x) * 4;
+		for (int row = 0; row < levelSize.y; row++)
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, levelSize.y - 1 - row, layer, levelSize.x, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, rows + row * rowSize);
+	}
+
+	// Remplacer une couche et calculer ses niveaux de détail sur le CPU (voir generateMipmapChain). Seule cette couche est envoyée, contrairement à glGenerateMipmap qui recalcule toutes les couches.
+	void setLayerPixels(int layer, const void* pixels, bool flipVertically = true, bool isSrgb = true) {
+		setLayerLevel(layer, 0, pixels, flipVertically);
+		auto levels = generateMipmapChain((const uint8_t*)pixels, size, numLevels, isSrgb);
+		for (int i = 0; i < (int)levels.size(); i++)
+			setLayerLevel(layer, i + 1, levels[i].pixels.data(), flipVertically);
+	}
+
+	// Réserver une couche et y mettre une image. Retourne la couche, ou -1 si l'image n'a pas la taille des couches ou s'il n'y a plus de couche libre.
+	int addImage(const sf::Image& image, bool isSrgb = true) {
+		return addPixels(image, true, isSrgb);
+	}
+
+	int addImageFile(const std::string& filename, bool isSrgb = true) {
+		sf::Image image;
+		if (not image.loadFromFile(filename)) {
+			std::cerr << "ERROR " << filename << " could not be loaded" << "\n";
+			return -1;
+		}
+		// L'image nous appartient : on la renverse sur le CPU plutôt que d'envoyer chaque niveau rangée par rangée.
+		image.flipVertically();
+		return addPixels(image, false, isSrgb);
+	}
+
+	// Générer les niveaux de détail de toutes les couches sur le GPU.
+	void generateMipmaps() {
+		if (numLevels <= 1)
+			return;
+		glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	}
+
+	// Donner la couche des appels de dessin suivants quand l'attribut par instance n'est pas activé (appels sans instances, par exemple BasicMesh::draw, qui désactive les attributs d'instance laissés dans le VAO par drawInstanced).
+	static void setCurrentLayer(int layer) {
+		glVertexAttrib1f(layerLocation, (float)layer);
+	}
+
+	void deleteObject() {
+		recordGpuFree(GpuMemoryCategory::Texture, id);
+		glDeleteTextures(1, &id);
+		id = 0;
+		freeLayers.clear();
+	}
+
+	// Créer un tableau de numLayers couches RGBA de la taille donnée, toutes libres, avec detailLevels niveaux de détail (limité à une chaîne complète). Comme Texture::create, le stockage est immuable (glTexStorage3D) si le contexte le permet.
+	static TextureArray create(ivec2 size, int numLayers, int detailLevels = 1) {
+		GLint maxLayers = 0;
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+		if (numLayers < 1 or numLayers > maxLayers) {
+			std::cerr << "ERROR texture arrays need between 1 and " << maxLayers << " layers" << "\n";
+			return {};
+		}
+		TextureArray result = {};
+		result.size = size;
+		result.numLayers = numLayers;
+		result.numLevels = std::clamp(detailLevels, 1, getNumMipLevels(size));
+		for (int layer = numLayers - 1; layer >= 0; layer--)
+			result.freeLayers.push_back(layer);
+
+		glGenTextures(1, &result.id);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, result.id);
+		if (isGLVersionOrExtensionSupported(4, 2, "GL_ARB_texture_storage")) {
+			glTexStorage3D(GL_TEXTURE_2D_ARRAY, result.numLevels, GL_RGBA8, size.x, size.y, numLayers);
+		} else {
+			for (int level = 0; level < result.numLevels; level++) {
+				ivec2 levelSize = getMipLevelSize(size, level);
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, levelSize.x, levelSize.y, numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			}
+		}
+		// Mêmes modes de filtrage que Texture.
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, result.numLevels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, result.numLevels - 1);
+
+		size_t numBytes = 0;
+		for (int level = 0; level < result.numLevels; level++) {
+			ivec2 levelSize = getMipLevelSize(size, level);
+			numBytes += size_t(levelSize.x) * levelSize.y * 4 * numLayers;
+		}
+		recordGpuAllocation(GpuMemoryCategory::Texture, result.id, numBytes, "TextureArray");
+		return result;
+	}
+
+private:
+	int addPixels(const sf::Image& image, bool flipVertically, bool isSrgb) {
+		ivec2 imageSize = {image.getSize().x, image.getSize().y};
+		if (imageSize != size) {
+			std::cerr << "ERROR image of " << imageSize.x << "x" << imageSize.y << " does not match texture array layers of " << size.x << "x" << size.y << "\n";
+			return -1;
+		}
+		int layer = allocateLayer();
+		if (layer < 0) {
+			std::cerr << "ERROR texture array is full (" << numLayers << " layers)" << "\n";
+			return -1;
+		}
+		setLayerPixels(layer, image.getPixelsPtr(), flipVertically, isSrgb);
+		return layer;
+	}
+};
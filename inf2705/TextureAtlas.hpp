@@ -0,0 +1,305 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+#include <SFML/Graphics.hpp>
+
+#include "GpuMemory.hpp"
+#include "Mipmaps.hpp"
+#include "Texture.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Placement de rectangles dans une page par l'algorithme de la ligne d'horizon (skyline) : on garde le profil du haut des rectangles déjà placés, une suite de segments horizontaux, et chaque nouveau rectangle est posé là où son haut serait le plus bas. C'est presque aussi compact que maxrects pour des images de tailles variées, avec beaucoup moins d'état.
+class SkylinePacker
+{
+public:
+	SkylinePacker(ivec2 size = {}) { reset(size); }
+
+	void reset(ivec2 size) {
+		size_ = size;
+		skyline_ = {{0, 0, size.x}};
+		usedArea_ = 0;
+	}
+
+	// Retourne faux si le rectangle n'entre plus dans la page.
+	bool insert(ivec2 rectSize, ivec2& position) {
+		int bestIndex = -1;
+		int bestTop = INT_MAX;
+		int bestWidth = INT_MAX;
+		for (int i = 0; i < (int)skyline_.size(); i++) {
+			int y = 0;
+			if (not fits(i, rectSize, y))
+				continue;
+			// Le haut le plus bas, puis le segment le plus étroit pour laisser les grands espaces aux grands rectangles.
+			if (y + rectSize.y < bestTop or (y + rectSize.y == bestTop and skyline_[i].width < bestWidth)) {
+				bestIndex = i;
+				bestTop = y + rectSize.y;
+				bestWidth = skyline_[i].width;
+				position = {skyline_[i].x, y};
+			}
+		}
+		if (bestIndex < 0)
+			return false;
+
+		// Le nouveau segment recouvre le début des segments suivants, qu'on raccourcit ou retire.
+		skyline_.insert(skyline_.begin() + bestIndex, {position.x, bestTop, rectSize.x});
+		int right = position.x + rectSize.x;
+		for (size_t j = bestIndex + 1; j < skyline_.size();) {
+			auto& segment = skyline_[j];
+			if (segment.x >= right)
+				break;
+			int overlap = right - segment.x;
+			segment.x += overlap;
+			segment.width -= overlap;
+			if (segment.width > 0)
+				break;
+			skyline_.erase(skyline_.begin() + j);
+		}
+		// Fusionner les segments voisins à la même hauteur.
+		for (size_t j = 0; j + 1 < skyline_.size();) {
+			if (skyline_[j].y == skyline_[j + 1].y) {
+				skyline_[j].width += skyline_[j + 1].width;
+				skyline_.erase(skyline_.begin() + j + 1);
+			} else {
+				j++;
+			}
+		}
+		usedArea_ += size_t(rectSize.x) * rectSize.y;
+		return true;
+	}
+
+	// La fraction de la page couverte par des rectangles.
+	float getOccupancy() const {
+		return size_.x * size_.y == 0 ? 0 : float(usedArea_) / (size_t(size_.x) * size_.y);
+	}
+
+private:
+	struct Segment
+	{
+		int x;
+		int y;
+		int width;
+	};
+
+	// Le rectangle posé au début du segment i repose sur le plus haut des segments qu'il couvre.
+	bool fits(int i, ivec2 rectSize, int& y) const {
+		if (skyline_[i].x + rectSize.x > size_.x)
+			return false;
+		y = 0;
+		int widthLeft = rectSize.x;
+		for (int j = i; widthLeft > 0; j++) {
+			y = std::max(y, skyline_[j].y);
+			if (y + rectSize.y > size_.y)
+				return false;
+			widthLeft -= skyline_[j].width;
+		}
+		return true;
+	}
+
+	ivec2 size_ = {};
+	std::vector<Segment> skyline_;
+	size_t usedArea_ = 0;
+};
+
+// La place d'une image dans un atlas, et la transformation de ses coordonnées de texture : uv dans l'image devient uvOffset + uv * uvScale dans la page.
+struct AtlasRegion
+{
+	int page = -1;
+	ivec2 position = {}; // Coin bas-gauche de l'image dans la page, en texels.
+	ivec2 size = {};
+	vec2 uvOffset = {};
+	vec2 uvScale = {};
+
+	bool isValid() const { return page >= 0; }
+
+	vec2 remap(vec2 texCoords) const { return uvOffset + texCoords * uvScale; }
+
+	// Pour faire la transformation dans le nuanceur de sommets plutôt que dans les sommets : texCoords = transform.xy + a_texCoords * transform.zw.
+	vec4 getUvTransform() const { return {uvOffset.x, uvOffset.y, uvScale.x, uvScale.y}; }
+};
+
+// Appliquer la transformation d'une région aux coordonnées de texture d'un mesh. Les coordonnées doivent rester dans [0, 1] : la répétition (GL_REPEAT) n'a pas de sens dans un atlas, elle échantillonnerait les images voisines.
+template <typename Vertex>
+inline void remapTexCoords(std::vector<Vertex>& vertices, const AtlasRegion& region) {
+	for (auto&& vertex : vertices)
+		vertex.texCoords = region.remap(vertex.texCoords);
+}
+
+// Un atlas de textures : les petites images et les couleurs unies sont regroupées dans quelques grandes pages plutôt que d'avoir chacune leur objet de texture. Les objets qui partagent une page peuvent être tracés sans changer de texture entre eux (et donc être regroupés dans un même appel de dessin, voir InstanceBuffer et GeometryArena); il suffit de transformer leurs coordonnées de texture (AtlasRegion).
+// Les couleurs identiques ne sont ajoutées qu'une fois (addColor), de même que les images du même nom (addImageFile).
+// Chaque image est entourée d'une bordure (gutter) qui répète ses texels du bord, pour que le filtrage bilinéaire et les niveaux de détail ne mélangent pas les images voisines. Avec des niveaux de détail, les images sont placées sur une grille de 2^(numLevels - 1) texels et la bordure fait au moins cette largeur, ce qui laisse au moins un texel de bordure au dernier niveau. Il vaut donc mieux garder peu de niveaux (3 ou 4).
+// Les pages sont gardées en mémoire côté CPU et envoyées par upload(), à appeler après les ajouts (les pages modifiées sont renvoyées au complet).
+class TextureAtlas
+{
+public:
+	TextureAtlas(ivec2 pageSize = {1024, 1024}, int numLevels = 1, int padding = 2, bool isSrgb = true)
+	: pageSize_(pageSize), numLevels_(std::clamp(numLevels, 1, getNumMipLevels(pageSize))), isSrgb_(isSrgb) {
+		cellSize_ = 1 << (numLevels_ - 1);
+		padding_ = std::max(padding, numLevels_ > 1 ? cellSize_ : 0);
+	}
+
+	TextureAtlas(const TextureAtlas&) = delete;
+	TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+	// Ajouter une image RGBA de 8 bits. Si flipVertically, la première rangée est le haut de l'image (voir Texture::loadFromPixels). Retourne une région invalide si l'image est plus grande qu'une page.
+	AtlasRegion add(const uint8_t* pixels, ivec2 size, bool flipVertically = true) {
+		// Le rectangle réservé, bordure comprise, en cellules de la grille.
+		ivec2 paddedSize = size + 2 * padding_;
+		ivec2 numCells = (paddedSize + cellSize_ - 1) / cellSize_;
+		if (numCells.x * cellSize_ > pageSize_.x or numCells.y * cellSize_ > pageSize_.y) {
+			std::cerr << "ERROR image of " << size.x << "x" << size.y << " does not fit in a texture atlas page" << "\n";
+			return {};
+		}
+		// Essayer les pages existantes, puis en ajouter une.
+		ivec2 cellPosition;
+		int page = 0;
+		while (page < (int)pages_.size() and not pages_[page].packer.insert(numCells, cellPosition))
+			page++;
+		if (page == (int)pages_.size()) {
+			addPage();
+			pages_[page].packer.insert(numCells, cellPosition);
+		}
+
+		AtlasRegion region;
+		region.page = page;
+		region.position = cellPosition * cellSize_ + padding_;
+		region.size = size;
+		region.uvOffset = vec2(region.position) / vec2(pageSize_);
+		region.uvScale = vec2(size) / vec2(pageSize_);
+
+		// Remplir tout le rectangle réservé : l'image au centre, et dans la bordure le texel de l'image le plus proche.
+		auto& pagePixels = pages_[page].pixels;
+		ivec2 cellBegin = cellPosition * cellSize_;
+		ivec2 cellEnd = min(cellBegin + numCells * cellSize_, pageSize_);
+		for (int y = cellBegin.y; y < cellEnd.y; y++) {
+			int row = std::clamp(y - region.position.y, 0, size.y - 1);
+			if (flipVertically)
+				row = size.y - 1 - row;
+			const uint8_t* srcRow = pixels + size_t(row) * size.x * 4;
+			uint8_t* dstRow = pagePixels.data() + size_t(y) * pageSize_.x * 4;
+			for (int x = cellBegin.x; x < cellEnd.x; x++) {
+				int column = std::clamp(x - region.position.x, 0, size.x - 1);
+				std::memcpy(dstRow + size_t(x) * 4, srcRow + size_t(column) * 4, 4);
+			}
+		}
+		pages_[page].isDirty = true;
+		return region;
+	}
+
+	// Ajouter une image chargée par SFML (origine en haut à gauche).
+	AtlasRegion addImage(const sf::Image& image) {
+		return add(image.getPixelsPtr(), {image.getSize().x, image.getSize().y});
+	}
+
+	// Ajouter une image à partir d'un fichier, une seule fois par nom de fichier.
+	AtlasRegion addImageFile(const std::string& filename) {
+		if (auto it = regionsByName_.find(filename); it != regionsByName_.end())
+			return it->second;
+		sf::Image image;
+		if (not image.loadFromFile(filename)) {
+			std::cerr << "ERROR " << filename << " could not be loaded" << "\n";
+			return {};
+		}
+		AtlasRegion region = addImage(image);
+		if (region.isValid())
+			regionsByName_[filename] = region;
+		return region;
+	}
+
+	// Ajouter une couleur unie, une seule fois par valeur (après conversion en 8 bits par composante). La région a une échelle nulle : toutes les coordonnées de texture échantillonnent le texel du centre, un mesh sans coordonnées de texture peut donc l'utiliser tel quel.
+	AtlasRegion addColor(vec4 color) {
+		uint8_t texel[4];
+		for (int c = 0; c < 4; c++)
+			texel[c] = (uint8_t)std::clamp(int(color[c] * 255 + 0.5f), 0, 255);
+		uint32_t key;
+		std::memcpy(&key, texel, 4);
+		if (auto it = colors_.find(key); it != colors_.end())
+			return it->second;
+		AtlasRegion region = add(texel, {1, 1}, false);
+		if (not region.isValid())
+			return region;
+		region.uvOffset += 0.5f / vec2(pageSize_);
+		region.uvScale = {0, 0};
+		colors_[key] = region;
+		return region;
+	}
+
+	// La région d'une image ajoutée par addImageFile, invalide si elle n'y est pas.
+	AtlasRegion getRegion(const std::string& filename) const {
+		auto it = regionsByName_.find(filename);
+		return it != regionsByName_.end() ? it->second : AtlasRegion{};
+	}
+
+	// Envoyer les pages modifiées depuis le dernier appel, avec leurs niveaux de détail calculés sur le CPU. Doit être appelée dans le fil du contexte OpenGL.
+	void upload() {
+		for (auto&& page : pages_) {
+			if (not page.isDirty)
+				continue;
+			if (page.texture.id == 0) {
+				page.texture = Texture::create(pageSize_, numLevels_);
+				GpuMemoryRegistry::getDefault().setName(GpuMemoryCategory::Texture, page.texture.id, "TextureAtlas");
+			}
+			// Les pages sont déjà dans l'ordre des rangées d'OpenGL (voir add).
+			page.texture.setPixelData(GL_RGBA, page.pixels.data());
+			page.texture.setMipLevels(generateMipmapChain(page.pixels.data(), pageSize_, numLevels_, isSrgb_), false);
+			page.isDirty = false;
+		}
+	}
+
+	void bindPage(int page, int textureUnit) {
+		pages_[page].texture.bindToTextureUnit(textureUnit);
+	}
+
+	Texture& getPage(int page) { return pages_[page].texture; }
+	int getNumPages() const { return (int)pages_.size(); }
+	float getOccupancy(int page) const { return pages_[page].packer.getOccupancy(); }
+
+	void deleteObjects() {
+		for (auto&& page : pages_)
+			page.texture.deleteObject();
+		pages_.clear();
+		colors_.clear();
+		regionsByName_.clear();
+	}
+
+private:
+	struct Page
+	{
+		SkylinePacker packer;
+		std::vector<uint8_t> pixels;
+		Texture texture;
+		bool isDirty = true;
+	};
+
+	void addPage() {
+		Page page;
+		page.packer.reset(pageSize_ / cellSize_);
+		page.pixels.assign(size_t(pageSize_.x) * pageSize_.y * 4, 0);
+		pages_.push_back(std::move(page));
+	}
+
+	ivec2 pageSize_;
+	int numLevels_;
+	int cellSize_ = 1;
+	int padding_ = 0;
+	bool isSrgb_;
+	std::vector<Page> pages_;
+	std::unordered_map<uint32_t, AtlasRegion> colors_;
+	std::unordered_map<std::string, AtlasRegion> regionsByName_;
+};
@@ -0,0 +1,492 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cfloat>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+#include "utils.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Les formats compressés par blocs (BCn, aussi appelés S3TC/DXT et BPTC) découpent l'image en blocs de 4x4 texels encodés dans 8 ou 16 octets. Le GPU les décode à l'échantillonnage : la texture prend 4 à 8 fois moins de mémoire graphique et de bande passante qu'en RGBA.
+enum class TextureCompression
+{
+	None,
+	BC1, // RGB, 8 octets par bloc (0.5 octet par texel). Deux couleurs de référence de 16 bits et 2 bits par texel pour choisir parmi 4 couleurs interpolées. L'alpha est ignoré.
+	BC3, // RGBA, 16 octets par bloc. Un bloc BC1 pour la couleur plus un bloc d'alpha (deux valeurs de référence et 3 bits par texel).
+	BC7, // RGBA, 16 octets par bloc, meilleure qualité que BC3. Demande OpenGL 4.2 (ou ARB_texture_compression_bptc).
+};
+
+inline size_t getCompressedBlockSize(TextureCompression format) {
+	return format == TextureCompression::BC1 ? 8 : 16;
+}
+
+// La taille en octets d'un niveau compressé : les blocs débordent de l'image quand la taille n'est pas un multiple de 4.
+inline size_t getCompressedLevelSize(TextureCompression format, ivec2 size) {
+	return size_t((size.x + 3) / 4) * ((size.y + 3) / 4) * getCompressedBlockSize(format);
+}
+
+inline GLenum getCompressedGLFormat(TextureCompression format) {
+	switch (format) {
+	case TextureCompression::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TextureCompression::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case TextureCompression::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default: return GL_RGBA8;
+	}
+}
+
+// S3TC est une extension, mais elle est offerte par tous les pilotes de bureau (y compris macOS). BC7 fait partie d'OpenGL 4.2.
+inline bool isCompressionSupported(TextureCompression format) {
+	switch (format) {
+	case TextureCompression::None: return true;
+	case TextureCompression::BC7: return isGLVersionOrExtensionSupported(4, 2, "GL_ARB_texture_compression_bptc");
+	default: return isGLExtensionSupported("GL_EXT_texture_compression_s3tc");
+	}
+}
+
+// Les fonctions d'encodage d'un bloc reçoivent les 16 texels RGBA du bloc, rangée par rangée.
+namespace bcn
+{
+	inline uint16_t packColor565(vec3 color) {
+		auto r = (uint16_t)std::clamp(int(color.r * 31 / 255 + 0.5f), 0, 31);
+		auto g = (uint16_t)std::clamp(int(color.g * 63 / 255 + 0.5f), 0, 63);
+		auto b = (uint16_t)std::clamp(int(color.b * 31 / 255 + 0.5f), 0, 31);
+		return uint16_t(r << 11 | g << 5 | b);
+	}
+
+	inline vec3 unpackColor565(uint16_t color) {
+		int r = color >> 11 & 31, g = color >> 5 & 63, b = color & 31;
+		return {float(r << 3 | r >> 2), float(g << 2 | g >> 4), float(b << 3 | b >> 2)};
+	}
+
+	inline float distanceSquared(vec3 a, vec3 b) {
+		vec3 d = a - b;
+		return d.x * d.x + d.y * d.y + d.z * d.z;
+	}
+
+	// L'axe principal des couleurs du bloc (le vecteur propre dominant de leur covariance), par itération de puissance. Les couleurs d'un bloc sont souvent presque alignées : les interpoler le long de cet axe perd beaucoup moins que le long de la diagonale de leur boîte englobante.
+	template <int N>
+	inline std::array<float, N> computePrincipalAxis(const std::array<std::array<float, N>, 16>& texels, std::array<float, N>& mean) {
+		mean = {};
+		for (auto&& texel : texels)
+			for (int c = 0; c < N; c++)
+				mean[c] += texel[c] / 16;
+		float covariance[N][N] = {};
+		for (auto&& texel : texels)
+			for (int i = 0; i < N; i++)
+				for (int j = 0; j < N; j++)
+					covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+		std::array<float, N> axis;
+		axis.fill(1);
+		for (int iteration = 0; iteration < 8; iteration++) {
+			std::array<float, N> next = {};
+			for (int i = 0; i < N; i++)
+				for (int j = 0; j < N; j++)
+					next[i] += covariance[i][j] * axis[j];
+			float length = 0;
+			for (float v : next)
+				length = std::max(length, std::abs(v));
+			if (length < 1e-6f)
+				break;
+			for (int i = 0; i < N; i++)
+				axis[i] = next[i] / length;
+		}
+		return axis;
+	}
+
+	// Choisir la couleur la plus proche pour chaque texel parmi les 4 de la palette. Retourne l'erreur totale.
+	inline float selectColorIndices(const std::array<std::array<float, 3>, 16>& texels, uint16_t c0, uint16_t c1, uint32_t& indices) {
+		vec3 e0 = unpackColor565(c0), e1 = unpackColor565(c1);
+		// L'ordre des indices dans le format : 0 et 1 sont les extrémités, 2 et 3 les couleurs à 1/3 et 2/3.
+		vec3 palette[4] = {e0, e1, (2.0f * e0 + e1) / 3.0f, (e0 + 2.0f * e1) / 3.0f};
+		indices = 0;
+		float error = 0;
+		for (int i = 0; i < 16; i++) {
+			vec3 color = {texels[i][0], texels[i][1], texels[i][2]};
+			int best = 0;
+			float bestDistance = distanceSquared(color, palette[0]);
+			for (int p = 1; p < 4; p++) {
+				float distance = distanceSquared(color, palette[p]);
+				if (distance < bestDistance) {
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices |= uint32_t(best) << (2 * i);
+			error += bestDistance;
+		}
+		return error;
+	}
+
+	// Les extrémités qui minimisent l'erreur (moindres carrés) pour les indices choisis : chaque texel vaut a * e0 + b * e1, avec (a, b) fixé par son indice.
+	inline bool refineColorEndpoints(const std::array<std::array<float, 3>, 16>& texels, uint32_t indices, vec3& e0, vec3& e1) {
+		static constexpr float weights[4] = {1, 0, 2.0f / 3, 1.0f / 3};
+		float aa = 0, ab = 0, bb = 0;
+		vec3 ax = {}, bx = {};
+		for (int i = 0; i < 16; i++) {
+			float a = weights[indices >> (2 * i) & 3];
+			float b = 1 - a;
+			vec3 color = {texels[i][0], texels[i][1], texels[i][2]};
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			ax += a * color;
+			bx += b * color;
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::abs(determinant) < 1e-6f)
+			return false;
+		e0 = (ax * bb - bx * ab) / determinant;
+		e1 = (bx * aa - ax * ab) / determinant;
+		return true;
+	}
+
+	// Encoder la couleur d'un bloc en BC1 (toujours en mode 4 couleurs, c0 > c1, qui est aussi le seul mode du bloc de couleur de BC3).
+	inline void encodeColorBlock(const uint8_t* block, uint8_t* out) {
+		std::array<std::array<float, 3>, 16> texels;
+		for (int i = 0; i < 16; i++)
+			texels[i] = {float(block[i * 4]), float(block[i * 4 + 1]), float(block[i * 4 + 2])};
+		std::array<float, 3> mean;
+		auto axisArray = computePrincipalAxis<3>(texels, mean);
+		vec3 axis = {axisArray[0], axisArray[1], axisArray[2]};
+		vec3 center = {mean[0], mean[1], mean[2]};
+
+		// Les extrémités sont les projections extrêmes sur l'axe, rapprochées de 1/16 de l'intervalle : les couleurs interpolées couvrent alors mieux le milieu, où sont la plupart des texels.
+		float minT = FLT_MAX, maxT = -FLT_MAX;
+		for (auto&& texel : texels) {
+			float t = dot(vec3(texel[0], texel[1], texel[2]) - center, axis);
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+		float inset = (maxT - minT) / 16;
+		vec3 e0 = center + axis * (maxT - inset);
+		vec3 e1 = center + axis * (minT + inset);
+
+		uint16_t bestC0 = 0, bestC1 = 0;
+		uint32_t bestIndices = 0;
+		float bestError = FLT_MAX;
+		auto tryEndpoints = [&](vec3 e0, vec3 e1) {
+			uint16_t c0 = packColor565(e0), c1 = packColor565(e1);
+			if (c0 < c1)
+				std::swap(c0, c1);
+			uint32_t indices = 0;
+			float error = 0;
+			// Un bloc uni : c0 == c1 donnerait le mode 3 couleurs. Tous les indices à 0 donnent la couleur c0 dans les deux modes.
+			if (c0 == c1) {
+				for (auto&& texel : texels)
+					error += distanceSquared({texel[0], texel[1], texel[2]}, unpackColor565(c0));
+			} else {
+				error = selectColorIndices(texels, c0, c1, indices);
+			}
+			if (error < bestError) {
+				bestError = error;
+				bestC0 = c0;
+				bestC1 = c1;
+				bestIndices = indices;
+			}
+		};
+		tryEndpoints(e0, e1);
+		// Recalculer les extrémités pour les indices choisis, ce qui compense en partie la quantification en 5:6:5.
+		if (bestC0 != bestC1 and refineColorEndpoints(texels, bestIndices, e0, e1))
+			tryEndpoints(e0, e1);
+
+		std::memcpy(out, &bestC0, 2);
+		std::memcpy(out + 2, &bestC1, 2);
+		std::memcpy(out + 4, &bestIndices, 4);
+	}
+
+	// Encoder l'alpha d'un bloc BC3 : deux valeurs a0 > a1 et 6 valeurs interpolées, 3 bits par texel.
+	inline void encodeAlphaBlock(const uint8_t* block, uint8_t* out) {
+		int a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; i++) {
+			a0 = std::max(a0, int(block[i * 4 + 3]));
+			a1 = std::min(a1, int(block[i * 4 + 3]));
+		}
+		out[0] = uint8_t(a0);
+		out[1] = uint8_t(a1);
+		uint64_t indices = 0;
+		if (a0 != a1) {
+			// L'ordre des indices : 0 et 1 sont les extrémités, 2 à 7 vont de a0 vers a1.
+			int palette[8] = {a0, a1};
+			for (int i = 1; i < 7; i++)
+				palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+			for (int i = 0; i < 16; i++) {
+				int alpha = block[i * 4 + 3];
+				int best = 0;
+				for (int p = 1; p < 8; p++) {
+					if (std::abs(alpha - palette[p]) < std::abs(alpha - palette[best]))
+						best = p;
+				}
+				indices |= uint64_t(best) << (3 * i);
+			}
+		}
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = uint8_t(indices >> (8 * i));
+	}
+
+	inline void encodeBlockBC1(const uint8_t* block, uint8_t* out) {
+		encodeColorBlock(block, out);
+	}
+
+	inline void encodeBlockBC3(const uint8_t* block, uint8_t* out) {
+		encodeAlphaBlock(block, out);
+		encodeColorBlock(block, out + 8);
+	}
+
+	// Écrire des champs de bits dans un bloc de 128 bits, en commençant par les bits de poids faible du premier octet.
+	struct BitWriter
+	{
+		uint8_t* out;
+		int position = 0;
+
+		void write(uint32_t value, int numBits) {
+			for (int i = 0; i < numBits; i++, position++)
+				out[position / 8] |= uint8_t((value >> i & 1) << (position % 8));
+		}
+	};
+
+	// Encoder un bloc en BC7 avec le mode 6 seulement : un seul ensemble d'extrémités RGBA de 7 bits plus un bit partagé (p-bit) par extrémité, et 4 bits (16 valeurs) par texel. C'est le mode le plus polyvalent; les encodeurs complets essaient aussi les modes à plusieurs partitions pour les blocs qui contiennent des couleurs très différentes, au prix d'un encodage beaucoup plus long.
+	inline void encodeBlockBC7(const uint8_t* block, uint8_t* out) {
+		static constexpr int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+		std::array<std::array<float, 4>, 16> texels;
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 4; c++)
+				texels[i][c] = block[i * 4 + c];
+		std::array<float, 4> mean;
+		auto axis = computePrincipalAxis<4>(texels, mean);
+		float minT = FLT_MAX, maxT = -FLT_MAX;
+		for (auto&& texel : texels) {
+			float t = 0;
+			for (int c = 0; c < 4; c++)
+				t += (texel[c] - mean[c]) * axis[c];
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+
+		// Essayer les 4 combinaisons de p-bits et garder la meilleure. Les indices sont choisis par projection sur le segment entre les extrémités décodées, plutôt qu'en comparant aux 16 valeurs de la palette.
+		std::array<int, 4> bestQ0 = {}, bestQ1 = {};
+		int bestP0 = 0, bestP1 = 0;
+		std::array<int, 16> bestIndices = {};
+		float bestError = FLT_MAX;
+		for (int p0 = 0; p0 < 2; p0++) {
+			for (int p1 = 0; p1 < 2; p1++) {
+				std::array<int, 4> q0, q1;
+				std::array<float, 4> d0, d1;
+				for (int c = 0; c < 4; c++) {
+					float e0 = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+					float e1 = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+					q0[c] = std::clamp(int((e0 - p0) / 2 + 0.5f), 0, 127);
+					q1[c] = std::clamp(int((e1 - p1) / 2 + 0.5f), 0, 127);
+					d0[c] = float(q0[c] << 1 | p0);
+					d1[c] = float(q1[c] << 1 | p1);
+				}
+				float lengthSquared = 0;
+				for (int c = 0; c < 4; c++)
+					lengthSquared += (d1[c] - d0[c]) * (d1[c] - d0[c]);
+				std::array<int, 16> indices = {};
+				float error = 0;
+				for (int i = 0; i < 16; i++) {
+					float t = 0;
+					for (int c = 0; c < 4; c++)
+						t += (texels[i][c] - d0[c]) * (d1[c] - d0[c]);
+					float weight = lengthSquared > 0 ? t / lengthSquared * 64 : 0;
+					int index = 0;
+					for (int k = 1; k < 16; k++) {
+						if (std::abs(weights[k] - weight) < std::abs(weights[index] - weight))
+							index = k;
+					}
+					indices[i] = index;
+					for (int c = 0; c < 4; c++) {
+						float decoded = float(((64 - weights[index]) * int(d0[c]) + weights[index] * int(d1[c]) + 32) >> 6);
+						error += (decoded - texels[i][c]) * (decoded - texels[i][c]);
+					}
+				}
+				if (error < bestError) {
+					bestError = error;
+					bestQ0 = q0;
+					bestQ1 = q1;
+					bestP0 = p0;
+					bestP1 = p1;
+					bestIndices = indices;
+				}
+			}
+		}
+
+		// L'indice du premier texel n'a que 3 bits : son bit de poids fort doit être 0. Sinon on inverse les extrémités, ce qui inverse les indices.
+		if (bestIndices[0] >= 8) {
+			std::swap(bestQ0, bestQ1);
+			std::swap(bestP0, bestP1);
+			for (int& index : bestIndices)
+				index = 15 - index;
+		}
+
+		std::memset(out, 0, 16);
+		BitWriter writer = {out};
+		writer.write(1 << 6, 7); // Le mode 6 : six 0 puis un 1.
+		for (int c = 0; c < 4; c++) {
+			writer.write(bestQ0[c], 7);
+			writer.write(bestQ1[c], 7);
+		}
+		writer.write(bestP0, 1);
+		writer.write(bestP1, 1);
+		writer.write(bestIndices[0], 3);
+		for (int i = 1; i < 16; i++)
+			writer.write(bestIndices[i], 4);
+	}
+}
+
+// Compresser une image RGBA de 8 bits. Si flipVertically, la première rangée de `pixels` est le haut de l'image (voir Texture::loadFromPixels) : on lit les rangées à l'envers en formant les blocs, puisqu'on ne peut pas renverser une image compressée pendant l'envoi. Les texels des blocs qui débordent de l'image sont ceux du bord.
+// Les rangées de blocs sont réparties entre les fils de `pool` (nullptr pour tout faire dans le fil courant).
+inline std::vector<uint8_t> compressImage(const uint8_t* pixels, ivec2 size, TextureCompression format, bool flipVertically = true, ThreadPool* pool = &ThreadPool::getDefault()) {
+	ivec2 numBlocks = {(size.x + 3) / 4, (size.y + 3) / 4};
+	size_t blockSize = getCompressedBlockSize(format);
+	std::vector<uint8_t> result(size_t(numBlocks.x) * numBlocks.y * blockSize);
+	auto encodeBlock = format == TextureCompression::BC1 ? bcn::encodeBlockBC1 : format == TextureCompression::BC3 ? bcn::encodeBlockBC3 : bcn::encodeBlockBC7;
+
+	auto encodeBlockRow = [&](size_t blockY) {
+		uint8_t block[16 * 4];
+		for (int blockX = 0; blockX < numBlocks.x; blockX++) {
+			for (int y = 0; y < 4; y++) {
+				int row = std::min(int(blockY) * 4 + y, size.y - 1);
+				if (flipVertically)
+					row = size.y - 1 - row;
+				for (int x = 0; x < 4; x++) {
+					int column = std::min(blockX * 4 + x, size.x - 1);
+					std::memcpy(block + (y * 4 + x) * 4, pixels + (size_t(row) * size.x + column) * 4, 4);
+				}
+			}
+			encodeBlock(block, result.data() + (blockY * numBlocks.x + blockX) * blockSize);
+		}
+	};
+
+	if (pool != nullptr)
+		pool->parallelFor(0, numBlocks.y, encodeBlockRow, 4);
+	else
+		for (int blockY = 0; blockY < numBlocks.y; blockY++)
+			encodeBlockRow(blockY);
+	return result;
+}
+
+// En-tête du cache de texture compressée (voir Texture::loadFromFileCompressed), écrit à côté de l'image source comme le cache de mesh. Il est suivi d'une TextureCacheLevel par niveau de détail, puis des blocs de chaque niveau alignés sur 16 octets, exactement comme ils sont passés à glCompressedTexImage2D.
+struct TextureCacheHeader
+{
+	char magic[8] = {'I', 'N', 'F', '2', '7', '0', '5', 'T'};
+	uint32_t version = 1;
+	uint32_t format = 0;
+	// Clé de l'image source et des options d'encodage : le cache est invalide si un de ces champs ne correspond plus.
+	uint64_t sourceSize = 0;
+	int64_t sourceWriteTime = 0;
+	uint64_t sourceHash = 0;
+	uint32_t requestedLevels = 0;
+	uint32_t flippedVertically = 0;
+	uint32_t isSrgb = 0;
+	// Le contenu.
+	int32_t width = 0;
+	int32_t height = 0;
+	uint32_t numLevels = 0;
+};
+
+struct TextureCacheLevel
+{
+	uint64_t offset = 0;
+	uint64_t size = 0;
+};
+
+// Valider l'en-tête d'un cache projeté en mémoire par rapport à la clé attendue. Retourne la table des niveaux, vide si le cache est invalide.
+inline std::vector<TextureCacheLevel> readTextureCache(const MappedFile& cacheFile, const TextureCacheHeader& key, TextureCacheHeader& header) {
+	if (cacheFile.size() < sizeof(TextureCacheHeader))
+		return {};
+	std::memcpy(&header, cacheFile.data(), sizeof(header));
+
+	TextureCacheHeader expected = {};
+	bool isValid = std::memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0 and
+	               header.version == expected.version and
+	               header.format == key.format and
+	               header.sourceSize == key.sourceSize and
+	               header.sourceWriteTime == key.sourceWriteTime and
+	               header.sourceHash == key.sourceHash and
+	               header.requestedLevels == key.requestedLevels and
+	               header.flippedVertically == key.flippedVertically and
+	               header.isSrgb == key.isSrgb and
+	               header.numLevels != 0;
+	size_t tableEnd = sizeof(TextureCacheHeader) + header.numLevels * sizeof(TextureCacheLevel);
+	if (not isValid or cacheFile.size() < tableEnd)
+		return {};
+
+	std::vector<TextureCacheLevel> levels(header.numLevels);
+	std::memcpy(levels.data(), cacheFile.data() + sizeof(TextureCacheHeader), levels.size() * sizeof(TextureCacheLevel));
+	// Vérifier que les blocs de chaque niveau sont bien dans le fichier et ont la taille attendue.
+	for (uint32_t i = 0; i < header.numLevels; i++) {
+		ivec2 levelSize = {std::max(header.width >> i, 1), std::max(header.height >> i, 1)};
+		bool isConsistent = levels[i].size == getCompressedLevelSize((TextureCompression)header.format, levelSize) and
+		                    levels[i].offset + levels[i].size <= cacheFile.size();
+		if (not isConsistent)
+			return {};
+	}
+	return levels;
+}
+
+// Écrire le cache. On écrit dans un fichier temporaire puis on le renomme pour ne jamais laisser un cache à moitié écrit.
+inline bool writeTextureCache(const std::string& cacheFilename, const TextureCacheHeader& key, ivec2 size, const std::vector<std::vector<uint8_t>>& levels) {
+	auto alignUp = [](uint64_t offset) { return (offset + 15) / 16 * 16; };
+
+	TextureCacheHeader header = key;
+	header.width = size.x;
+	header.height = size.y;
+	header.numLevels = (uint32_t)levels.size();
+
+	std::vector<TextureCacheLevel> table;
+	uint64_t offset = alignUp(sizeof(TextureCacheHeader) + levels.size() * sizeof(TextureCacheLevel));
+	for (auto&& level : levels) {
+		table.push_back({offset, level.size()});
+		offset = alignUp(offset + level.size());
+	}
+
+	std::string tempFilename = cacheFilename + ".tmp";
+	{
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+		if (not file)
+			return false;
+		auto padTo = [&](uint64_t target) {
+			static const char zeros[16] = {};
+			file.write(zeros, target - (uint64_t)file.tellp());
+		};
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)table.data(), table.size() * sizeof(TextureCacheLevel));
+		for (size_t i = 0; i < levels.size(); i++) {
+			padTo(table[i].offset);
+			file.write((const char*)levels[i].data(), levels[i].size());
+		}
+		padTo(offset);
+		if (not file)
+			return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempFilename, cacheFilename, error);
+	if (error) {
+		std::cerr << "WARNING could not write texture cache " << cacheFilename << ": " << error.message() << "\n";
+		std::filesystem::remove(tempFilename, error);
+		return false;
+	}
+	return true;
+}
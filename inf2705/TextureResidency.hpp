@@ -0,0 +1,348 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+#include <SFML/Graphics.hpp>
+
+#include "GpuMemory.hpp"
+#include "Mipmaps.hpp"
+#include "Texture.hpp"
+#include "ThreadPool.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Gestionnaire de résidence des niveaux de détail : les textures sont d'abord affichées avec leurs petits niveaux seulement, puis les niveaux plus fins sont envoyés en mémoire graphique au fil des trames selon la taille des objets à l'écran, et retirés quand la mémoire manque. Un grand nombre de textures est ainsi visible tout de suite, sans que tous les niveaux 0 soient en mémoire graphique.
+// Les niveaux envoyés sont toujours une suite [residentLevel, numLevels) : GL_TEXTURE_BASE_LEVEL est remonté au premier niveau présent, l'échantillonnage n'utilise donc jamais un niveau absent. Pour pouvoir libérer un niveau, les textures ne sont pas immuables (pas de glTexStorage2D) : chaque niveau est alloué (glTexImage2D) quand il est envoyé et réduit à 0x0 quand il est retiré.
+// Les formats d'image courants (PNG, JPEG) ne se décodent pas par niveau : l'image est décodée au complet dans une tâche du bassin avec tous ses niveaux (voir generateMipmapChain), qui sont gardés en mémoire centrale pour renvoyer un niveau retiré sans relire le fichier.
+// Utilisation, à chaque trame :
+//     residency.requestDetail(handle, TextureResidencyManager::estimateScreenSize(objectSize, distance, fovY, viewportHeight));
+//     residency.getTexture(handle).bindToTextureUnit(0, prog, "texMain");
+//     ...
+//     residency.update(4 << 20); // Après les dessins.
+class TextureResidencyManager
+{
+public:
+	// Doit être construit dans le fil du contexte OpenGL.
+	TextureResidencyManager(ThreadPool& pool = ThreadPool::getDefault()) : pool_(&pool), glThread_(std::this_thread::get_id()) {
+		evictionCallbackId_ = GpuMemoryRegistry::getDefault().addEvictionCallback([this](size_t bytesToFree) { return onGpuMemoryPressure(bytesToFree); });
+	}
+
+	~TextureResidencyManager() {
+		GpuMemoryRegistry::getDefault().removeEvictionCallback(evictionCallbackId_);
+	}
+
+	TextureResidencyManager(const TextureResidencyManager&) = delete;
+	TextureResidencyManager& operator=(const TextureResidencyManager&) = delete;
+
+	// Les niveaux dont le plus grand côté ne dépasse pas coarseSize sont envoyés dès que l'image est décodée et ne sont jamais retirés.
+	void setCoarseSize(int coarseSize) { coarseSize_ = std::max(coarseSize, 1); }
+
+	// La mémoire graphique permise pour les textures du gestionnaire (0 pour aucune limite). Le budget global du registre (GpuMemoryRegistry::setBudget) est aussi respecté : le gestionnaire y est inscrit comme fonction d'éviction.
+	void setBudget(size_t numBytes) { budget_ = numBytes; }
+
+	// Couleur de la texture affichée en attendant le décodage.
+	void setPlaceholderColor(vec4 color) { placeholderColor_ = color; }
+
+	// Commencer le chargement d'une image. Retourne l'identifiant de la texture pour les autres fonctions. Doit être appelée dans le fil du contexte OpenGL.
+	int add(const std::string& filename, bool isSrgb = true) {
+		auto& entry = entries_.emplace_back();
+		entry.filename = filename;
+		entry.decoded = pool_->submit([filename, isSrgb]() {
+			auto decoded = std::make_shared<DecodedImage>();
+			if (not decoded->image.loadFromFile(filename))
+				return std::shared_ptr<DecodedImage>();
+			// Renverser l'image ici plutôt qu'à chaque envoi de niveau (voir Texture::setPixelRowsFlipped) : les niveaux sont alors envoyés d'un seul appel.
+			decoded->image.flipVertically();
+			ivec2 size = {decoded->image.getSize().x, decoded->image.getSize().y};
+			// Dans le fil de cette tâche : on ne peut pas utiliser parallelFor à partir d'une tâche du bassin.
+			decoded->mipLevels = generateMipmapChain(decoded->image.getPixelsPtr(), size, getNumMipLevels(size), isSrgb, nullptr);
+			return decoded;
+		});
+		return int(entries_.size()) - 1;
+	}
+
+	// La texture à lier pour dessiner : la texture de remplacement tant que l'image n'est pas décodée (ou si elle n'a pas pu l'être).
+	Texture getTexture(int handle) {
+		auto& entry = entries_[handle];
+		if (entry.texture.id == 0)
+			return getPlaceholderTexture();
+		return entry.texture;
+	}
+
+	// Le premier niveau présent en mémoire graphique (numLevels tant que rien n'est envoyé).
+	int getResidentLevel(int handle) const { return entries_[handle].residentLevel; }
+
+	// Le niveau que les demandes de la trame courante rendent utile.
+	int getDesiredLevel(int handle) const { return entries_[handle].getDesiredLevel(); }
+
+	size_t getResidentBytes() const { return residentBytes_; }
+
+	// Nombre d'images pas encore décodées.
+	size_t getNumPending() const {
+		return std::count_if(entries_.begin(), entries_.end(), [](const Entry& entry) { return entry.decoded.valid(); });
+	}
+
+	// Indiquer que la texture est dessinée pendant cette trame sur environ screenSize pixels (le plus grand côté de sa surface à l'écran, voir estimateScreenSize). Le niveau voulu est celui qui a à peu près un texel par pixel, et les textures les plus grandes à l'écran sont servies en premier. On peut appeler la fonction plusieurs fois par trame (plusieurs objets) : la plus grande taille est gardée.
+	void requestDetail(int handle, float screenSize) {
+		auto& entry = entries_[handle];
+		entry.screenSize = std::max(entry.screenSize, screenSize);
+	}
+
+	// La taille approximative à l'écran, en pixels, d'un objet de taille worldSize à la distance donnée de la caméra, avec une projection perspective d'angle vertical fovY (en radians) dans une fenêtre de viewportHeight pixels de haut.
+	static float estimateScreenSize(float worldSize, float distance, float fovY, int viewportHeight) {
+		float visibleHeight = 2 * std::max(distance, 1e-4f) * std::tan(fovY / 2);
+		return worldSize / visibleHeight * viewportHeight;
+	}
+
+	// À appeler une fois par trame dans le fil du contexte OpenGL, après les demandes (requestDetail) :
+	// - envoie les petits niveaux des images dont le décodage est terminé;
+	// - envoie les niveaux plus fins demandés, un niveau à la fois par texture en commençant par les plus grandes à l'écran, jusqu'à environ uploadBudgetBytes octets (au moins un niveau pour toujours avancer);
+	// - sous le budget, retire les niveaux qui ne sont plus demandés, puis ceux des textures moins prioritaires que celle à servir.
+	// Les demandes sont ensuite effacées pour la trame suivante. Retourne le nombre d'octets envoyés.
+	size_t update(size_t uploadBudgetBytes) {
+		isUpdating_ = true;
+		size_t uploaded = 0;
+		for (auto&& entry : entries_) {
+			if (entry.decoded.valid() and entry.decoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+				uploaded += uploadCoarseLevels(entry);
+		}
+
+		// Servir les textures par ordre de priorité, un niveau à la fois, tant qu'il y a du budget : une texture très demandée ne prend pas toute la bande passante d'une trame.
+		bool isBudgetExhausted = false;
+		bool hasProgressed = true;
+		while (hasProgressed and not isBudgetExhausted) {
+			hasProgressed = false;
+			std::vector<Entry*> candidates;
+			for (auto&& entry : entries_) {
+				if (entry.texture.id != 0 and entry.residentLevel > entry.getDesiredLevel())
+					candidates.push_back(&entry);
+			}
+			if (candidates.empty())
+				break;
+			std::sort(candidates.begin(), candidates.end(), [](Entry* a, Entry* b) { return a->screenSize > b->screenSize; });
+			for (Entry* entry : candidates) {
+				int level = entry->residentLevel - 1;
+				size_t numBytes = getLevelByteSize(entry->texture.size, level);
+				if (uploaded > 0 and uploaded + numBytes > uploadBudgetBytes) {
+					isBudgetExhausted = true;
+					break;
+				}
+				// Faire de la place en retirant des niveaux moins prioritaires. S'il n'y en a pas assez, on ne retire rien (ce serait perdu sans permettre l'envoi) et la texture garde ses niveaux actuels.
+				size_t available = getAvailableBytes();
+				if (numBytes > available) {
+					if (evictLevels(numBytes - available, entry->screenSize, true) < numBytes - available)
+						continue;
+					evict(numBytes - available, entry->screenSize);
+				}
+				uploadLevel(*entry, level);
+				uploaded += numBytes;
+				hasProgressed = true;
+			}
+		}
+
+		// Sous le budget (qui a pu être réduit), retirer ce qui n'est plus demandé.
+		if (budget_ != 0 and residentBytes_ > budget_)
+			evict(residentBytes_ - budget_, 0);
+
+		for (auto&& entry : entries_)
+			entry.screenSize = 0;
+		isUpdating_ = false;
+		return uploaded;
+	}
+
+	// Retirer de la mémoire graphique au moins numBytes octets de niveaux fins, sauf ceux des textures au moins aussi grandes à l'écran que maxScreenSize (0 pour ne retirer que les niveaux qui ne sont pas demandés). Les niveaux qui ne sont pas demandés partent en premier, en commençant par les textures les plus petites à l'écran. Retourne le nombre d'octets libérés.
+	// La texture liée à GL_TEXTURE_2D sur l'unité active est remise comme elle était : evict peut être appelée au milieu du code de l'application, à partir de n'importe quelle allocation déclarée au registre (voir onGpuMemoryPressure).
+	size_t evict(size_t numBytes, float maxScreenSize) {
+		GLint previousTexture = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+		isEvicting_ = true;
+		size_t freed = evictLevels(numBytes, maxScreenSize, false);
+		isEvicting_ = false;
+		glBindTexture(GL_TEXTURE_2D, (GLuint)previousTexture);
+		return freed;
+	}
+
+	void deleteObjects() {
+		for (auto&& entry : entries_) {
+			entry.texture.deleteObject();
+			entry.cpuLevels.reset();
+		}
+		entries_.clear();
+		residentBytes_ = 0;
+		placeholderTexture_.deleteObject();
+	}
+
+private:
+	struct DecodedImage
+	{
+		sf::Image image;
+		std::vector<MipLevel> mipLevels;
+
+		const uint8_t* getLevelPixels(int level) const {
+			return level == 0 ? image.getPixelsPtr() : mipLevels[level - 1].pixels.data();
+		}
+	};
+
+	struct Entry
+	{
+		std::string filename;
+		std::future<std::shared_ptr<DecodedImage>> decoded; // Valide pendant le décodage.
+		std::shared_ptr<DecodedImage> cpuLevels; // Tous les niveaux, pour renvoyer ceux qui sont retirés.
+		Texture texture = {}; // id = 0 tant que l'image n'est pas décodée.
+		int coarseLevel = 0; // Le premier niveau toujours présent.
+		int residentLevel = 0; // Le premier niveau présent.
+		size_t residentBytes = 0;
+		float screenSize = 0; // La plus grande demande de la trame courante.
+
+		int getDesiredLevel() const {
+			if (screenSize <= 0)
+				return coarseLevel;
+			// log2(texels par pixel), arrondi vers le bas pour ne pas manquer de détail.
+			float texelsPerPixel = std::max(texture.size.x, texture.size.y) / screenSize;
+			int level = texelsPerPixel <= 1 ? 0 : int(std::floor(std::log2(texelsPerPixel)));
+			return std::clamp(level, 0, coarseLevel);
+		}
+	};
+
+	static size_t getLevelByteSize(ivec2 size, int level) {
+		ivec2 levelSize = getMipLevelSize(size, level);
+		return size_t(levelSize.x) * levelSize.y * 4;
+	}
+
+	// Ce qu'on peut encore envoyer sans dépasser le budget du gestionnaire ni celui du registre.
+	size_t getAvailableBytes() const {
+		size_t available = SIZE_MAX;
+		if (budget_ != 0)
+			available = budget_ - std::min(budget_, residentBytes_);
+		auto& registry = GpuMemoryRegistry::getDefault();
+		size_t globalBudget = registry.getBudget();
+		if (globalBudget != 0)
+			available = std::min(available, globalBudget - std::min(globalBudget, registry.getTotalStats().currentBytes));
+		return available;
+	}
+
+	// Créer la texture de l'image décodée avec ses niveaux [coarseLevel, numLevels).
+	size_t uploadCoarseLevels(Entry& entry) {
+		entry.cpuLevels = entry.decoded.get();
+		if (entry.cpuLevels == nullptr) {
+			std::cerr << "ERROR " << entry.filename << " could not be loaded" << "\n";
+			return 0;
+		}
+		ivec2 size = {entry.cpuLevels->image.getSize().x, entry.cpuLevels->image.getSize().y};
+		entry.texture.size = size;
+		entry.texture.numLevels = getNumMipLevels(size);
+		entry.coarseLevel = 0;
+		while (entry.coarseLevel < entry.texture.numLevels - 1 and std::max(getMipLevelSize(size, entry.coarseLevel).x, getMipLevelSize(size, entry.coarseLevel).y) > coarseSize_)
+			entry.coarseLevel++;
+		entry.residentLevel = entry.texture.numLevels;
+
+		glGenTextures(1, &entry.texture.id);
+		entry.texture.setFilteringModes();
+		size_t uploaded = 0;
+		for (int level = entry.texture.numLevels - 1; level >= entry.coarseLevel; level--) {
+			uploadLevel(entry, level);
+			uploaded += getLevelByteSize(size, level);
+		}
+		return uploaded;
+	}
+
+	// Envoyer le niveau juste avant le premier niveau présent, puis abaisser GL_TEXTURE_BASE_LEVEL une fois le niveau complet.
+	void uploadLevel(Entry& entry, int level) {
+		ivec2 levelSize = getMipLevelSize(entry.texture.size, level);
+		glBindTexture(GL_TEXTURE_2D, entry.texture.id);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, levelSize.x, levelSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, entry.cpuLevels->getLevelPixels(level));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+		entry.residentLevel = level;
+		setResidentBytes(entry, entry.residentBytes + getLevelByteSize(entry.texture.size, level));
+	}
+
+	// Parcourir les niveaux que retire evict, dans le même ordre, jusqu'à numBytes octets. Si isDryRun, rien n'est retiré : on compte seulement ce qui pourrait l'être.
+	size_t evictLevels(size_t numBytes, float maxScreenSize, bool isDryRun) {
+		std::vector<Entry*> candidates;
+		for (auto&& entry : entries_) {
+			if (entry.texture.id != 0 and entry.residentLevel < entry.coarseLevel)
+				candidates.push_back(&entry);
+		}
+		std::sort(candidates.begin(), candidates.end(), [](Entry* a, Entry* b) { return a->screenSize < b->screenSize; });
+		// Le premier niveau présent de chaque candidat, tel qu'il serait après les retraits déjà comptés.
+		std::vector<int> residentLevels;
+		for (Entry* entry : candidates)
+			residentLevels.push_back(entry->residentLevel);
+
+		size_t freed = 0;
+		// D'abord les niveaux plus fins que nécessaire, puis les niveaux demandés par les textures moins prioritaires.
+		for (bool isUnwantedOnly : {true, false}) {
+			for (size_t i = 0; i < candidates.size(); i++) {
+				Entry* entry = candidates[i];
+				if (not isUnwantedOnly and entry->screenSize >= maxScreenSize)
+					break;
+				int limit = isUnwantedOnly ? entry->getDesiredLevel() : entry->coarseLevel;
+				while (freed < numBytes and residentLevels[i] < limit) {
+					freed += isDryRun ? getLevelByteSize(entry->texture.size, residentLevels[i]) : evictLevel(*entry);
+					residentLevels[i]++;
+				}
+			}
+		}
+		return freed;
+	}
+
+	// Retirer le premier niveau présent : remonter GL_TEXTURE_BASE_LEVEL d'abord pour que la texture reste complète, puis réduire le niveau à 0x0 pour que le pilote libère sa mémoire. Retourne le nombre d'octets libérés.
+	size_t evictLevel(Entry& entry) {
+		int level = entry.residentLevel;
+		glBindTexture(GL_TEXTURE_2D, entry.texture.id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		entry.residentLevel = level + 1;
+		size_t numBytes = getLevelByteSize(entry.texture.size, level);
+		setResidentBytes(entry, entry.residentBytes - numBytes);
+		return numBytes;
+	}
+
+	void setResidentBytes(Entry& entry, size_t numBytes) {
+		residentBytes_ += numBytes - entry.residentBytes;
+		entry.residentBytes = numBytes;
+		recordGpuAllocation(GpuMemoryCategory::Texture, entry.texture.id, numBytes, entry.filename);
+	}
+
+	// Appelée par le registre quand le budget global est dépassé par une autre ressource. Pendant update, le gestionnaire tient déjà compte du budget global selon les priorités : on ne retire rien pour ne pas défaire les niveaux qu'il vient d'envoyer. Une allocation faite dans un autre fil (par exemple un UploadThread) ne peut pas faire d'appels OpenGL dans notre contexte.
+	size_t onGpuMemoryPressure(size_t bytesToFree) {
+		if (isUpdating_ or isEvicting_ or std::this_thread::get_id() != glThread_)
+			return 0;
+		return evict(bytesToFree, INFINITY);
+	}
+
+	const Texture& getPlaceholderTexture() {
+		if (placeholderTexture_.id == 0)
+			placeholderTexture_ = Texture::createFromColor(placeholderColor_);
+		return placeholderTexture_;
+	}
+
+	ThreadPool* pool_;
+	std::thread::id glThread_;
+	std::vector<Entry> entries_;
+	size_t residentBytes_ = 0;
+	size_t budget_ = 0;
+	int coarseSize_ = 64;
+	int evictionCallbackId_ = 0;
+	bool isUpdating_ = false;
+	bool isEvicting_ = false;
+	Texture placeholderTexture_;
+	vec4 placeholderColor_ = {0.5f, 0.5f, 0.5f, 1};
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <iostream>
+
+#include <glbinding/gl/gl.h>
+#include <glm/glm.hpp>
+
+#include "StreamingBuffer.hpp"
+#include "Texture.hpp"
+
+
+using namespace gl;
+using namespace glm;
+
+
+// Mises à jour de textures à chaque trame (vidéo, images procédurales, peinture, etc.) par des tampons de pixels (PBO). Avec setPixelData, glTexImage2D lit la mémoire du client pendant l'appel : le pilote doit copier l'image tout de suite ou attendre que le GPU ait fini d'utiliser la texture, ce qui bloque le fil qui trace.
+// Ici, les pixels sont écrits dans un StreamingBuffer (un anneau de régions projetées de façon persistante, une par trame) puis glTexSubImage2D les lit à partir d'une position dans ce tampon lié à GL_PIXEL_UNPACK_BUFFER. L'appel retourne tout de suite et la copie vers la texture se fait sur le GPU, pendant que le CPU écrit déjà la trame suivante dans une autre région.
+// On peut ne mettre à jour qu'un rectangle de la texture. Les pixels sont en RGBA de 8 bits, la première rangée en bas comme dans OpenGL.
+// Usage à chaque trame :
+//     streamer.beginFrame();
+//     streamer.update(tex, {0, 0}, tex.size, pixels);
+//     ... // Tracer avec tex.
+//     streamer.endFrame();
+class TextureStreamer
+{
+public:
+	TextureStreamer() = default;
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// Créer l'anneau avec frameSize octets de pixels par trame (par exemple largeur * hauteur * 4 pour une image complète).
+	bool create(size_t frameSize, int numFrames = 3) {
+		return buffer_.create(frameSize, numFrames);
+	}
+
+	// Attendre au besoin que le GPU ait fini de lire la région de cette trame (voir StreamingBuffer::beginFrame).
+	void beginFrame() { buffer_.beginFrame(); }
+	void endFrame() { buffer_.endFrame(); }
+
+	// Réserver la place d'un rectangle de pixels dans la trame courante. On écrit ensuite les rangées, contiguës, dans allocation.data (par exemple directement depuis un décodeur vidéo), puis on appelle submit. Retourne une allocation invalide si la trame est pleine.
+	StreamingAllocation allocate(ivec2 rectSize) {
+		// Un alignement de 4 suffit pour GL_UNPACK_ALIGNMENT, mais les pilotes copient plus vite à partir de positions plus alignées.
+		return buffer_.allocate(size_t(rectSize.x) * rectSize.y * 4, 64);
+	}
+
+	// Copier les pixels réservés avec allocate dans le rectangle de coin bas-gauche `offset` du niveau `level` de la texture.
+	bool submit(Texture& texture, const StreamingAllocation& allocation, ivec2 offset, ivec2 rectSize, int level = 0) {
+		if (not allocation.isValid())
+			return false;
+		ivec2 levelSize = getMipLevelSize(texture.size, level);
+		if (offset.x < 0 or offset.y < 0 or offset.x + rectSize.x > levelSize.x or offset.y + rectSize.y > levelSize.y) {
+			std::cerr << "ERROR texture update rectangle is outside of level " << level << "\n";
+			return false;
+		}
+		buffer_.commit(allocation);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_.getBuffer());
+		texture.setPixelRect(level, offset, rectSize, GL_RGBA, (const void*)allocation.offset);
+		// Laisser le tampon lié ferait lire les glTexImage2D suivants dans le PBO plutôt qu'à leur pointeur.
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return true;
+	}
+
+	// Copier un rectangle de pixels dans la trame courante puis dans la texture. srcRowLength est la largeur en pixels des rangées de `pixels` quand le rectangle est pris dans une image plus grande (0 : rectSize.x). Les rangées sont tassées pendant la copie.
+	bool update(Texture& texture, ivec2 offset, ivec2 rectSize, const void* pixels, int srcRowLength = 0, int level = 0) {
+		auto allocation = allocate(rectSize);
+		if (not allocation.isValid())
+			return false;
+		size_t rowSize = size_t(rectSize.x) * 4;
+		size_t srcRowSize = srcRowLength > 0 ? size_t(srcRowLength) * 4 : rowSize;
+		if (srcRowSize == rowSize) {
+			std::memcpy(allocation.data, pixels, allocation.size);
+		} else {
+			for (int row = 0; row < rectSize.y; row++)
+				std::memcpy(allocation.data + row * rowSize, (const std::byte*)pixels + row * srcRowSize, rowSize);
+		}
+		return submit(texture, allocation, offset, rectSize, level);
+	}
+
+	void deleteObject() { buffer_.deleteObject(); }
+
+	bool isPersistent() const { return buffer_.isPersistent(); }
+	size_t getFrameSize() const { return buffer_.getFrameSize(); }
+
+private:
+	StreamingBuffer buffer_;
+};
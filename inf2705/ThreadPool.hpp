@@ -0,0 +1,110 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+// Un bassin de fils d'exécution (thread pool). Les fils sont créés une seule fois et exécutent les tâches soumises dans l'ordre où elles arrivent.
+// ATTENTION: Une tâche ne doit pas attendre une autre tâche du même bassin (par exemple appeler parallelFor à partir d'une tâche), sinon on peut se retrouver avec tous les fils bloqués.
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned numThreads = std::thread::hardware_concurrency()) {
+		numThreads = std::max(numThreads, 1u);
+		for (unsigned i = 0; i < numThreads; i++)
+			workers_.emplace_back([this]() { workerLoop(); });
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator= (const ThreadPool&) = delete;
+
+	~ThreadPool() {
+		{
+			std::lock_guard lock(mutex_);
+			stopping_ = true;
+		}
+		condition_.notify_all();
+		for (auto&& worker : workers_)
+			worker.join();
+	}
+
+	unsigned getNumThreads() const { return (unsigned)workers_.size(); }
+
+	// Soumettre une tâche. Le résultat (ou l'exception lancée) est obtenu par le std::future retourné.
+	template <typename Func>
+	auto submit(Func&& func) -> std::future<std::invoke_result_t<Func>> {
+		using Result = std::invoke_result_t<Func>;
+		// std::function doit être copiable, on passe donc par un pointeur partagé vers la std::packaged_task.
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+		auto result = task->get_future();
+		{
+			std::lock_guard lock(mutex_);
+			tasks_.push([task]() { (*task)(); });
+		}
+		condition_.notify_one();
+		return result;
+	}
+
+	// Appeler func(i) pour chaque i dans [begin, end) en répartissant l'intervalle en blocs contigus entre les fils, et attendre la fin de tous les blocs.
+	template <typename Func>
+	void parallelFor(size_t begin, size_t end, Func&& func, size_t minBlockSize = 1) {
+		if (begin >= end)
+			return;
+		size_t count = end - begin;
+		// Quelques blocs par fil pour équilibrer la charge si certains blocs sont plus longs que d'autres.
+		size_t numBlocks = std::min<size_t>(getNumThreads() * 4, (count + minBlockSize - 1) / minBlockSize);
+		size_t blockSize = (count + numBlocks - 1) / numBlocks;
+
+		std::vector<std::future<void>> pending;
+		for (size_t blockBegin = begin; blockBegin < end; blockBegin += blockSize) {
+			size_t blockEnd = std::min(blockBegin + blockSize, end);
+			pending.push_back(submit([&func, blockBegin, blockEnd]() {
+				for (size_t i = blockBegin; i < blockEnd; i++)
+					func(i);
+			}));
+		}
+		// get() relance l'exception d'un bloc s'il y en a eu une.
+		for (auto&& f : pending)
+			f.get();
+	}
+
+	// Bassin partagé par toute l'application, créé à la première utilisation.
+	static ThreadPool& getDefault() {
+		static ThreadPool pool;
+		return pool;
+	}
+
+private:
+	void workerLoop() {
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock lock(mutex_);
+				condition_.wait(lock, [this]() { return stopping_ or not tasks_.empty(); });
+				if (stopping_ and tasks_.empty())
+					return;
+				task = std::move(tasks_.front());
+				tasks_.pop();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> workers_;
+	std::queue<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool stopping_ = false;
+};
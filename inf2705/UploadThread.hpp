@@ -0,0 +1,129 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include <glbinding/Binding.h>
+#include <glbinding/gl/gl.h>
+#include <SFML/Window.hpp>
+
+
+using namespace gl;
+
+
+// Un fil d'exécution avec son propre contexte OpenGL, partagé avec celui de la fenêtre, pour envoyer les grosses ressources (glTexImage2D, glBufferData) sans bloquer le fil qui trace. SFML partage les objets de tous ses contextes : les textures et les tampons créés dans ce fil sont utilisables par la fenêtre. Ce n'est pas le cas des VAO (ni des FBO), qui restent propres à un contexte et doivent être créés dans le fil principal (voir BasicMesh::uploadBuffers et setupVao).
+// Les commandes des deux contextes ne sont pas ordonnées entre elles. Après chaque tâche, on pose donc une barrière (glFenceSync) que le fil principal doit attendre avec waitForFence avant d'utiliser les objets. glWaitSync fait attendre le GPU, pas le CPU : le fil principal n'est jamais bloqué. Il faut seulement OpenGL 3.2 (ou ARB_sync), ce qu'ont aussi les pilotes logiciels comme llvmpipe de Mesa pour les tests sans écran.
+class UploadThread
+{
+public:
+	UploadThread() = default;
+	UploadThread(const UploadThread&) = delete;
+	UploadThread& operator=(const UploadThread&) = delete;
+
+	~UploadThread() {
+		stop();
+	}
+
+	// Démarrer le fil et créer son contexte. Doit être appelée du fil principal, après la création de la fenêtre. Retourne faux si le contexte n'a pas pu être créé.
+	bool start() {
+		if (thread_.joinable())
+			return true;
+		stopping_ = false;
+		std::promise<bool> started;
+		auto isStarted = started.get_future();
+		thread_ = std::thread([this, &started]() { threadLoop(started); });
+		if (not isStarted.get()) {
+			thread_.join();
+			return false;
+		}
+		return true;
+	}
+
+	// Terminer les tâches en attente et arrêter le fil.
+	void stop() {
+		if (not thread_.joinable())
+			return;
+		{
+			std::lock_guard lock(mutex_);
+			stopping_ = true;
+		}
+		condition_.notify_one();
+		thread_.join();
+	}
+
+	bool isRunning() const { return thread_.joinable(); }
+
+	// Exécuter func() dans le contexte du fil d'envoi. Le futur donne la barrière posée après la tâche, à passer à waitForFence avant d'utiliser ce que la tâche a créé.
+	template <typename Func>
+	std::future<GLsync> submit(Func&& func) {
+		auto task = std::make_shared<std::packaged_task<GLsync()>>([func = std::forward<Func>(func)]() mutable {
+			func();
+			GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+			// Sans glFlush, la barrière pourrait rester dans la file de commandes de ce contexte et ne jamais être atteinte du point de vue de l'autre.
+			glFlush();
+			return fence;
+		});
+		auto result = task->get_future();
+		{
+			std::lock_guard lock(mutex_);
+			tasks_.push([task]() { (*task)(); });
+		}
+		condition_.notify_one();
+		return result;
+	}
+
+	// Faire attendre la barrière par le GPU dans le contexte courant, puis la libérer.
+	static void waitForFence(GLsync fence) {
+		if (fence == nullptr)
+			return;
+		glWaitSync(fence, GL_NONE_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+	}
+
+private:
+	void threadLoop(std::promise<bool>& started) {
+		// Le constructeur de sf::Context crée un contexte partagé avec les autres contextes de SFML et l'active dans ce fil.
+		sf::Context context;
+		if (not context.setActive(true)) {
+			std::cerr << "ERROR could not activate the upload thread's OpenGL context" << "\n";
+			started.set_value(false);
+			return;
+		}
+		// Les fonctions de glbinding sont résolues par contexte : on enregistre celui-ci, identifié par son adresse, et on l'utilise dans ce fil.
+		auto contextHandle = (glbinding::ContextHandle)(uintptr_t)&context;
+		glbinding::Binding::initialize(contextHandle, nullptr, true, true);
+		started.set_value(true);
+
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock lock(mutex_);
+				condition_.wait(lock, [this]() { return stopping_ or not tasks_.empty(); });
+				if (stopping_ and tasks_.empty())
+					break;
+				task = std::move(tasks_.front());
+				tasks_.pop();
+			}
+			task();
+		}
+
+		glFinish();
+		glbinding::Binding::releaseContext(contextHandle);
+	}
+
+	std::thread thread_;
+	std::queue<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool stopping_ = false;
+};
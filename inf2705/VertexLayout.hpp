@@ -0,0 +1,147 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <type_traits>
+#include <utility>
+
+#include <glbinding/gl/gl.h>
+
+#include "utils.hpp"
+
+
+using namespace gl;
+
+
+// Description d'un attribut de sommet, c'est-à-dire les paramètres de glVertexAttribPointer pour un membre d'une struct de sommet.
+struct VertexAttribDescription
+{
+	GLuint location = 0;       // layout(location = ...) dans le nuanceur.
+	GLint numComponents = 0;   // 1 à 4.
+	GLenum type = GL_FLOAT;    // Type des composantes en mémoire.
+	bool isNormalized = false; // Entiers convertis en float dans [0,1] ou [-1,1].
+	bool isInteger = false;    // Entiers passés tels quels au nuanceur (ivec, uvec), donc avec glVertexAttribIPointer.
+	size_t offset = 0;         // Position du membre dans la struct.
+};
+
+// La liste des attributs d'un type de sommet. Il faut la spécialiser pour chaque type de sommet avec un membre statique constexpr `attribs` (un std::array de VertexAttribDescription), par exemple :
+//     template <>
+//     struct VertexLayout<MyVertex>
+//     {
+//         static constexpr std::array attribs = {
+//             makeVertexAttrib<decltype(MyVertex::position)>(0, offsetof(MyVertex, position)),
+//         };
+//     };
+// La spécialisation doit être à l'extérieur de la struct de sommet, puisque offsetof a besoin d'un type complet.
+template <typename Vertex>
+struct VertexLayout;
+
+// Le type des composantes d'un membre (le type lui-même pour un scalaire, sinon le value_type du vecteur glm).
+template <typename T>
+struct VertexComponentType { using type = T; };
+
+template <typename T> requires requires { typename T::value_type; }
+struct VertexComponentType<T> { using type = typename T::value_type; };
+
+template <typename T>
+inline constexpr GLint getNumVertexComponents() {
+	if constexpr (std::is_arithmetic_v<T>)
+		return 1;
+	else
+		return (GLint)T::length();
+}
+
+// Attribut lu tel quel (float en mémoire vers float dans le nuanceur, ou entiers convertis en float sans normalisation).
+template <typename T>
+inline constexpr VertexAttribDescription makeVertexAttrib(GLuint location, size_t offset) {
+	using Component = typename VertexComponentType<T>::type;
+	return {location, getNumVertexComponents<T>(), getTypeGLenum<Component>(), false, false, offset};
+}
+
+// Attribut entier normalisé. On peut lire moins de composantes que le type n'en contient (par exemple xyz d'un u16vec4 aligné sur 8 octets).
+template <typename T>
+inline constexpr VertexAttribDescription makeNormalizedVertexAttrib(GLuint location, size_t offset, GLint numComponents = getNumVertexComponents<T>()) {
+	using Component = typename VertexComponentType<T>::type;
+	static_assert(isTypeOneOf_v<Component, GLbyte, GLubyte, GLshort, GLushort, GLint, GLuint>, "Normalized attributes need integer components");
+	return {location, numComponents, getTypeGLenum<Component>(), true, false, offset};
+}
+
+// Attribut de demi-flottants (16 bits) stockés dans des entiers non signés de 16 bits.
+template <typename T>
+inline constexpr VertexAttribDescription makeHalfVertexAttrib(GLuint location, size_t offset) {
+	using Component = typename VertexComponentType<T>::type;
+	static_assert(isTypeOneOf_v<Component, GLushort, GLshort>, "Half float attributes need 16-bit components");
+	return {location, getNumVertexComponents<T>(), GL_HALF_FLOAT, false, false, offset};
+}
+
+// Attribut entier passé tel quel au nuanceur (int, ivec, uint, uvec).
+template <typename T>
+inline constexpr VertexAttribDescription makeIntegerVertexAttrib(GLuint location, size_t offset) {
+	using Component = typename VertexComponentType<T>::type;
+	static_assert(isTypeOneOf_v<Component, GLbyte, GLubyte, GLshort, GLushort, GLint, GLuint>, "Integer attributes need integer components");
+	return {location, getNumVertexComponents<T>(), getTypeGLenum<Component>(), false, true, offset};
+}
+
+template <VertexAttribDescription attrib>
+inline void enableVertexAttrib(GLsizei stride, size_t baseOffset) {
+	static_assert(attrib.type != GL_INVALID_ENUM, "Unsupported vertex attribute component type");
+	auto pointer = (const void*)(baseOffset + attrib.offset);
+	if constexpr (attrib.isInteger)
+		glVertexAttribIPointer(attrib.location, attrib.numComponents, attrib.type, stride, pointer);
+	else
+		glVertexAttribPointer(attrib.location, attrib.numComponents, attrib.type, attrib.isNormalized ? GL_TRUE : GL_FALSE, stride, pointer);
+	glEnableVertexAttribArray(attrib.location);
+}
+
+// Configurer tous les attributs d'un type de sommet pour le VAO et le VBO présentement liés. La liste est déroulée à la compilation : chaque attribut devient un appel direct à glVertexAttribPointer avec des paramètres constants. baseOffset est la position (en octets) du premier sommet dans le VBO.
+template <typename Vertex>
+inline void setupVertexAttribs(size_t baseOffset = 0) {
+	constexpr auto& attribs = VertexLayout<Vertex>::attribs;
+	[&]<size_t... I>(std::index_sequence<I...>) {
+		(enableVertexAttrib<attribs[I]>((GLsizei)sizeof(Vertex), baseOffset), ...);
+	}(std::make_index_sequence<attribs.size()>());
+}
+
+// Comme setupVertexAttribs, mais pour des données par instance : chaque attribut avance d'un élément toutes les `divisor` instances plutôt qu'à chaque sommet.
+template <typename Instance>
+inline void setupInstanceAttribs(size_t baseOffset = 0, GLuint divisor = 1) {
+	setupVertexAttribs<Instance>(baseOffset);
+	for (auto&& attrib : VertexLayout<Instance>::attribs)
+		glVertexAttribDivisor(attrib.location, divisor);
+}
+
+// Les localisations des attributs d'un type de sommet ou d'instance, un bit par localisation.
+template <typename Vertex>
+inline constexpr uint32_t getVertexAttribMask() {
+	uint32_t mask = 0;
+	for (auto&& attrib : VertexLayout<Vertex>::attribs)
+		mask |= 1u << attrib.location;
+	return mask;
+}
+
+// Activer ou désactiver les tableaux des attributs de locationMask (voir getVertexAttribMask) dans le VAO présentement lié. Un attribut désactivé reçoit la valeur constante donnée par glVertexAttrib* plutôt que de lire un tampon.
+inline void setVertexAttribArraysEnabled(uint32_t locationMask, bool isEnabled) {
+	for (GLuint location = 0; locationMask != 0; location++, locationMask >>= 1) {
+		if ((locationMask & 1) == 0)
+			continue;
+		if (isEnabled)
+			glEnableVertexAttribArray(location);
+		else
+			glDisableVertexAttribArray(location);
+	}
+}
+
+// Hachage de la disposition d'un type de sommet (taille et attributs), par exemple pour qu'un cache sur disque ne soit relu que par le même type de sommet. Deux types de même taille mais de dispositions différentes ont des hachages différents. Les champs sont hachés un à un pour ne pas dépendre du bourrage de VertexAttribDescription.
+template <typename Vertex>
+inline uint64_t hashVertexLayout() {
+	uint64_t vertexSize = sizeof(Vertex);
+	uint64_t h = hashBytes(&vertexSize, sizeof(vertexSize));
+	for (auto&& attrib : VertexLayout<Vertex>::attribs) {
+		uint64_t fields[] = {attrib.location, (uint64_t)attrib.numComponents, (uint64_t)attrib.type, attrib.isNormalized, attrib.isInteger, attrib.offset};
+		h = hashBytes(fields, sizeof(fields), h);
+	}
+	return h;
+}
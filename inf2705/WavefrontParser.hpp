@@ -0,0 +1,287 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tiny_obj_loader.h>
+
+#include "ThreadPool.hpp"
+
+
+// Un objet (défini par « o » ou « g ») dans un fichier Wavefront : une plage de coins de triangles dans WavefrontData::indices.
+struct WavefrontShape
+{
+	std::string name;
+	size_t firstIndex = 0;
+	size_t numIndices = 0;
+};
+
+// Le contenu géométrique d'un fichier Wavefront analysé par WavefrontData::parseFile. On réutilise les structures de tinyobj pour que Mesh construise les sommets de la même façon qu'avec tinyobj. Les faces sont déjà séparées en triangles, donc trois indices par triangle.
+struct WavefrontData
+{
+	tinyobj::attrib_t attribs;
+	std::vector<tinyobj::index_t> indices;
+	std::vector<WavefrontShape> shapes;
+
+	// Analyser un fichier Wavefront sans passer par tinyobj. Le fichier est lu par blocs d'environ chunkSize octets par fil; chaque bloc est coupé en morceaux qui finissent sur une fin de ligne et qui sont analysés en parallèle, puis les résultats sont fusionnés dans l'ordre. La lecture du bloc suivant se fait dans ce fil pendant que le bassin analyse le bloc courant : au plus deux blocs de texte sont en mémoire, jamais le fichier entier.
+	// Seuls les éléments géométriques (v, vt, vn, f, o, g) sont lus, les matériaux et autres éléments sont ignorés. Doit être appelée hors d'une tâche de `pool`, puisqu'elle attend l'analyse des morceaux.
+	static WavefrontData parseFile(const std::string& filename, ThreadPool& pool = ThreadPool::getDefault(), size_t chunkSize = 4 << 20) {
+		std::ifstream file(filename, std::ios::binary);
+		if (not file) {
+			std::cerr << "ERROR could not open " << filename << "\n";
+			return {};
+		}
+
+		WavefrontData result;
+		result.shapes.push_back({});
+
+		size_t blockSize = chunkSize * pool.getNumThreads();
+		// Le texte lu mais pas encore analysé : le début d'une ligne coupée à la fin du bloc précédent, puis le bloc courant.
+		std::string buffer;
+		bool isLastBlock = not readBlock(file, buffer, blockSize);
+		while (true) {
+			// Ne traiter que jusqu'à la dernière fin de ligne, le reste sera complété par le prochain bloc.
+			size_t lastNewline = buffer.rfind('\n');
+			size_t end = isLastBlock ? buffer.size() : (lastNewline == std::string::npos ? 0 : lastNewline + 1);
+			std::string next = buffer.substr(end);
+
+			// Découper en morceaux alignés sur les lignes et les analyser en parallèle.
+			std::string_view text(buffer.data(), end);
+			std::vector<std::future<Chunk>> pending;
+			size_t begin = 0;
+			while (begin < text.size()) {
+				size_t chunkEnd = std::min(begin + chunkSize, text.size());
+				chunkEnd = std::min(text.find('\n', chunkEnd - 1) + 1, text.size());
+				if (chunkEnd == 0)
+					chunkEnd = text.size();
+				std::string_view chunkText = text.substr(begin, chunkEnd - begin);
+				pending.push_back(pool.submit([chunkText]() { return parseChunk(chunkText); }));
+				begin = chunkEnd;
+			}
+			// Lire le bloc suivant pendant l'analyse. `buffer` doit rester intact jusqu'à la fin des tâches, qui en lisent des morceaux.
+			bool isNextLastBlock = isLastBlock or not readBlock(file, next, blockSize);
+			for (auto&& chunk : pending)
+				result.mergeChunk(chunk.get());
+
+			if (isLastBlock)
+				break;
+			buffer = std::move(next);
+			isLastBlock = isNextLastBlock;
+		}
+
+		// Terminer le dernier objet et retirer les objets vides (par exemple un « g » sans faces).
+		result.shapes.back().numIndices = result.indices.size() - result.shapes.back().firstIndex;
+		std::erase_if(result.shapes, [](const WavefrontShape& shape) { return shape.numIndices == 0; });
+
+		if (not result.validateIndices()) {
+			std::cerr << "ERROR " << filename << ": face refers to an undefined vertex position" << "\n";
+			return {};
+		}
+		return result;
+	}
+
+private:
+	// Ajouter au plus numBytes octets du fichier à la fin de `buffer`. Retourne faux à la fin du fichier.
+	static bool readBlock(std::ifstream& file, std::string& buffer, size_t numBytes) {
+		size_t leftover = buffer.size();
+		buffer.resize(leftover + numBytes);
+		file.read(buffer.data() + leftover, numBytes);
+		buffer.resize(leftover + (size_t)file.gcount());
+		return bool(file);
+	}
+
+	// Le résultat de l'analyse d'un morceau. Les indices négatifs (relatifs à la fin de la liste, permis en Wavefront) sont convertis par rapport au début du morceau, puisqu'on ne connaît pas encore le nombre d'éléments des morceaux précédents. Ceux-ci sont corrigés lors de la fusion.
+	struct Chunk
+	{
+		std::vector<float> positions;
+		std::vector<float> texCoords;
+		std::vector<float> normals;
+		std::vector<tinyobj::index_t> indices;
+		// Indices (dans `indices`) des coins dont au moins un élément est relatif au morceau, et masque des éléments concernés (1 = position, 2 = coords de texture, 4 = normale).
+		std::vector<std::pair<size_t, uint8_t>> relativeIndices;
+		// Changements d'objet : indice du premier coin du nouvel objet et son nom.
+		std::vector<std::pair<size_t, std::string>> shapeStarts;
+	};
+
+	void mergeChunk(Chunk&& chunk) {
+		int basePosition = int(attribs.vertices.size() / 3);
+		int baseTexCoords = int(attribs.texcoords.size() / 2);
+		int baseNormal = int(attribs.normals.size() / 3);
+		size_t baseIndex = indices.size();
+
+		attribs.vertices.insert(attribs.vertices.end(), chunk.positions.begin(), chunk.positions.end());
+		attribs.texcoords.insert(attribs.texcoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+		attribs.normals.insert(attribs.normals.end(), chunk.normals.begin(), chunk.normals.end());
+		indices.insert(indices.end(), chunk.indices.begin(), chunk.indices.end());
+
+		for (auto&& [i, mask] : chunk.relativeIndices) {
+			auto& idx = indices[baseIndex + i];
+			if (mask & 1)
+				idx.vertex_index += basePosition;
+			if (mask & 2)
+				idx.texcoord_index += baseTexCoords;
+			if (mask & 4)
+				idx.normal_index += baseNormal;
+		}
+
+		for (auto&& [i, name] : chunk.shapeStarts) {
+			auto& current = shapes.back();
+			current.numIndices = baseIndex + i - current.firstIndex;
+			// Un objet sans faces est simplement renommé plutôt que d'en créer un autre.
+			if (current.numIndices == 0)
+				current.name = std::move(name);
+			else
+				shapes.push_back({std::move(name), baseIndex + i, 0});
+		}
+	}
+
+	bool validateIndices() {
+		int numPositions = int(attribs.vertices.size() / 3);
+		int numTexCoords = int(attribs.texcoords.size() / 2);
+		int numNormals = int(attribs.normals.size() / 3);
+		for (auto&& idx : indices) {
+			if (idx.vertex_index < 0 or idx.vertex_index >= numPositions)
+				return false;
+			// Une coordonnée de texture ou une normale invalide est simplement ignorée.
+			if (idx.texcoord_index >= numTexCoords)
+				idx.texcoord_index = -1;
+			if (idx.normal_index >= numNormals)
+				idx.normal_index = -1;
+		}
+		return true;
+	}
+
+	static Chunk parseChunk(std::string_view text) {
+		Chunk chunk;
+		// Estimation grossière (environ 30 octets par ligne) pour éviter la plupart des réallocations.
+		chunk.positions.reserve(text.size() / 30);
+		chunk.indices.reserve(text.size() / 30);
+
+		const char* ptr = text.data();
+		const char* end = text.data() + text.size();
+		std::vector<tinyobj::index_t> polygon;
+		std::vector<uint8_t> polygonMasks;
+		while (ptr < end) {
+			const char* lineEnd = std::find(ptr, end, '\n');
+			std::string_view line(ptr, lineEnd - ptr);
+			ptr = lineEnd + 1;
+
+			skipSpaces(line);
+			if (line.size() < 2)
+				continue;
+
+			bool isKeywordEnd = line[1] == ' ' or line[1] == '\t';
+			if (line[0] == 'v' and isKeywordEnd) {
+				line.remove_prefix(2);
+				for (int i = 0; i < 3; i++)
+					chunk.positions.push_back(parseFloat(line));
+			} else if (line[0] == 'v' and line[1] == 't') {
+				line.remove_prefix(2);
+				for (int i = 0; i < 2; i++)
+					chunk.texCoords.push_back(parseFloat(line));
+			} else if (line[0] == 'v' and line[1] == 'n') {
+				line.remove_prefix(2);
+				for (int i = 0; i < 3; i++)
+					chunk.normals.push_back(parseFloat(line));
+			} else if (line[0] == 'f' and isKeywordEnd) {
+				line.remove_prefix(2);
+				parseFace(line, chunk, polygon, polygonMasks);
+			} else if ((line[0] == 'o' or line[0] == 'g') and isKeywordEnd) {
+				line.remove_prefix(2);
+				chunk.shapeStarts.push_back({chunk.indices.size(), trim(line)});
+			}
+		}
+		return chunk;
+	}
+
+	static void parseFace(std::string_view line, Chunk& chunk, std::vector<tinyobj::index_t>& polygon, std::vector<uint8_t>& polygonMasks) {
+		int numPositions = int(chunk.positions.size() / 3);
+		int numTexCoords = int(chunk.texCoords.size() / 2);
+		int numNormals = int(chunk.normals.size() / 3);
+
+		// Lire les coins de la face (v, v/vt, v//vn ou v/vt/vn) en convertissant les indices en base 0.
+		polygon.clear();
+		polygonMasks.clear();
+		skipSpaces(line);
+		while (not line.empty()) {
+			tinyobj::index_t idx = {-1, -1, -1};
+			uint8_t mask = 0;
+			auto resolve = [&](int value, int localCount, uint8_t bit) {
+				if (value > 0)
+					return value - 1;
+				mask |= bit;
+				return localCount + value;
+			};
+
+			size_t lengthBefore = line.size();
+			idx.vertex_index = resolve(parseInt(line), numPositions, 1);
+			if (not line.empty() and line[0] == '/') {
+				line.remove_prefix(1);
+				if (not line.empty() and line[0] != '/')
+					idx.texcoord_index = resolve(parseInt(line), numTexCoords, 2);
+				if (not line.empty() and line[0] == '/') {
+					line.remove_prefix(1);
+					idx.normal_index = resolve(parseInt(line), numNormals, 4);
+				}
+			}
+			// Un coin mal formé termine la face plutôt que de boucler indéfiniment.
+			if (line.size() == lengthBefore)
+				break;
+
+			polygon.push_back(idx);
+			polygonMasks.push_back(mask);
+			skipSpaces(line);
+		}
+
+		// Séparer le polygone en triangles en éventail autour du premier coin.
+		for (size_t i = 2; i < polygon.size(); i++) {
+			for (size_t corner : {size_t(0), i - 1, i}) {
+				if (polygonMasks[corner] != 0)
+					chunk.relativeIndices.push_back({chunk.indices.size(), polygonMasks[corner]});
+				chunk.indices.push_back(polygon[corner]);
+			}
+		}
+	}
+
+	static void skipSpaces(std::string_view& str) {
+		size_t i = 0;
+		while (i < str.size() and (str[i] == ' ' or str[i] == '\t' or str[i] == '\r'))
+			i++;
+		str.remove_prefix(i);
+	}
+
+	static std::string trim(std::string_view str) {
+		skipSpaces(str);
+		while (not str.empty() and (str.back() == ' ' or str.back() == '\t' or str.back() == '\r'))
+			str.remove_suffix(1);
+		return std::string(str);
+	}
+
+	// std::from_chars ne fait pas d'allocation et ne dépend pas de la locale, contrairement à std::stof ou std::stringstream. C'est de loin la partie la plus coûteuse de l'analyse d'un fichier Wavefront.
+	static float parseFloat(std::string_view& str) {
+		skipSpaces(str);
+		if (not str.empty() and str[0] == '+')
+			str.remove_prefix(1);
+		float value = 0;
+		auto [next, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+		str.remove_prefix(next - str.data());
+		return value;
+	}
+
+	static int parseInt(std::string_view& str) {
+		int value = 0;
+		auto [next, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+		str.remove_prefix(next - str.data());
+		return value;
+	}
+};
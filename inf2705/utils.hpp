@@ -4,14 +4,16 @@
 #include <cstddef>
 #include <cstdint>
 
+#include <algorithm>
 #include <cctype>
 #include <cmath>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 
-#include <glbinding/gl/enum.h>
+#include <glbinding/gl/gl.h>
 
 
 inline std::string readFile(std::string_view filename) {
@@ -45,6 +47,17 @@ inline std::string replaceAll(std::string str, const std::string& oldSubStr, con
 	return str;
 }
 
+// Hachage FNV-1a 64 bits d'un bloc d'octets. Pas cryptographique, mais rapide et suffisant pour détecter qu'un fichier a changé.
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull) {
+	auto bytes = (const uint8_t*)data;
+	uint64_t h = seed;
+	for (size_t i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
 template <typename T>
 inline constexpr gl::GLenum getTypeGLenum() {
 	using namespace gl;
@@ -83,3 +96,28 @@ inline constexpr bool isTypeOneOf() {
 template <typename T1, typename T2, typename... Ts>
 constexpr bool isTypeOneOf_v = isTypeOneOf<T1, T2, Ts...>();
 
+// Vérifier si le contexte OpenGL courant offre l'extension donnée.
+inline bool isGLExtensionSupported(std::string_view extension) {
+	using namespace gl;
+
+	GLint numExtensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+	for (GLint i = 0; i < numExtensions; i++) {
+		auto name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (name != nullptr and extension == name)
+			return true;
+	}
+	return false;
+}
+
+// Vérifier si le contexte OpenGL courant est d'une version au moins major.minor ou s'il offre l'extension donnée.
+inline bool isGLVersionOrExtensionSupported(int major, int minor, std::string_view extension) {
+	using namespace gl;
+
+	GLint contextMajor = 0, contextMinor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+	glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+	if (contextMajor > major or (contextMajor == major and contextMinor >= minor))
+		return true;
+	return isGLExtensionSupported(extension);
+}